@@ -0,0 +1,115 @@
+#include <fstream>
+#include "frontend/pack.hpp"
+#include "frontend/bcn.hpp"
+
+/*
+	Bake asset pack from png files.
+
+	usage: bake [-z] [-c] [-b] out.pack file.png[:raw]...
+
+	-z  zlib compress pixel blobs
+	-c  block compress images (BC1 when opaque, BC3 with alpha)
+	-b  store uncompressed images as BGRA, for desktop drivers preferring
+	    it (Front::prefer_bgra); web builds convert them back on load
+	:raw  keep this image lossless (pixel art)
+	
+	A png with a sibling .lst file is baked as a PixFont (always lossless).
+	Mask-like images and fonts are stored as single channel R8.
+*/
+
+using namespace frontend;
+
+bool file_exists(filesys::Path const& path) {
+	std::ifstream f(path);
+	return bool(f);
+}
+
+bool ends_with(std::string const& s, std::string const& x) {
+	return s.size() >= x.size() and s.compare(s.size() - x.size(), x.size(), x) == 0;
+}
+
+int main(int argc, char * argv[]) {
+
+	PackWriter w;
+	bool use_bc = false;
+	bool use_bgra = false;
+
+	int i = 1;
+	while (i < argc and argv[i][0] == '-') {
+		std::string opt = argv[i++];
+		if (opt == "-z") {
+			w.compress = true;
+		}
+		else if (opt == "-c") {
+			use_bc = true;
+		}
+		else if (opt == "-b") {
+			use_bgra = true;
+		}
+		else {
+			print(std::cerr, "unknown option: %||\n", opt);
+			return 1;
+		}
+	}
+
+	if (argc - i < 1) {
+		print(std::cerr, "usage: bake [-z] [-c] [-b] out.pack file.png[:raw]...\n");
+		return 1;
+	}
+
+	filesys::Path out = argv[i++];
+
+	size_t raw_total = 0;
+	size_t vram_total = 0;
+
+	for (; i < argc; ++i) {
+		filesys::Path path = argv[i];
+
+		bool raw = false;
+		if (ends_with(path, ":raw")) {
+			path = path.substr(0, path.size() - 4);
+			raw = true;
+		}
+
+		auto img = load_png(path);
+		auto d = img.get_dim();
+		auto raw_bytes = get_texture_bytes(GL_RGBA, d);
+		raw_total += raw_bytes;
+
+		auto path_lst = get_lst_path(path);
+		if (file_exists(path_lst)) {
+			PixFont font;
+			scan_pixfont(font, img, path_lst);
+			w.add_font(path, img, font);
+			vram_total += get_texture_bytes(is_mask(img, img(v2s(0,0))) ? GL_R8 : GL_RGBA, d);
+			print("font  %|| (%|| glyphs)\n", path, font.glyphs.size());
+		}
+		else {
+			GLenum format = GL_RGBA;
+			if (is_mask(img, Color(0,0,0,0))) {
+				format = GL_R8;
+			}
+			else if (use_bc and not raw) {
+				format = has_alpha(img) ? FormatBC3 : FormatBC1;
+			}
+			else if (use_bgra) {
+				format = FormatBGRA;
+			}
+			w.add_image(path, img, format);
+
+			auto bytes = get_texture_bytes(format, d);
+			vram_total += bytes;
+			print("image %|| %||x%|| %|| vram %|| -> %||\n", path, d[0], d[1],
+				(format == FormatBC1) ? "bc1" : (format == FormatBC3) ? "bc3" : (format == GL_R8) ? "r8" : (format == FormatBGRA) ? "bgra" : "rgba",
+				raw_bytes, bytes
+			);
+		}
+	}
+
+	w.write(out);
+	print("wrote %||: %|| entries, %|| bytes stored\n", out, w.get_count(), w.get_data_size());
+	// sampled bytes per texel follow vram: 4 (rgba), 1 (bc3, r8), 0.5 (bc1)
+	print("vram: %|| bytes (%|| as rgba)\n", vram_total, raw_total);
+
+	return 0;
+}
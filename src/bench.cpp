@@ -0,0 +1,230 @@
+#include <chrono>
+#include <random>
+#include "frontend/front.hpp"
+#include "frontend/spatialgrid.hpp"
+#include "frontend/texstream.hpp"
+
+/*
+	Micro benchmarks of frontend parts.
+
+	usage: bench [grid|upload]
+
+	upload opens a window; other benchmarks are cpu only.
+*/
+
+using namespace frontend;
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_us(Clock::time_point t0, int reps) {
+	auto d = std::chrono::duration<double, std::micro>(Clock::now() - t0);
+	return d.count() / reps;
+}
+
+void bench_spatialgrid() {
+	// world of 64k x 64k pixels, 32px sprites, 1280x720 view
+	auto view = b2s(v2s(-640,-360), v2s(1280,720));
+	int const reps = 100;
+
+	print("spatial grid: viewport query vs object count\n");
+	print("%|10| %|10| %|12| %|12| %|12|\n", "objects", "visible", "grid us", "scan us", "move us");
+
+	for (size_t n: {1000, 10000, 100000, 1000000}) {
+		std::mt19937 rng(1);
+		std::uniform_int_distribution<int> coord(-32768, 32767 - 32);
+
+		SpatialGrid grid;
+		std::vector<b2s> boxes;
+		std::vector<SpatialGrid::Handle> hs;
+		for (size_t i = 0; i < n; ++i) {
+			auto b = b2s(v2s(int16_t(coord(rng)), int16_t(coord(rng))), v2s(32,32));
+			boxes.push_back(b);
+			hs.push_back(grid.insert(b, uint32_t(i)));
+		}
+
+		std::vector<SpatialGrid::Handle> out;
+		auto t0 = Clock::now();
+		for (int r = 0; r < reps; ++r) {
+			out.clear();
+			grid.query(view, out);
+		}
+		auto grid_us = elapsed_us(t0, reps);
+
+		// reference: test every box
+		size_t hits = 0;
+		t0 = Clock::now();
+		for (int r = 0; r < reps; ++r) {
+			hits = 0;
+			for (auto & b: boxes) {
+				if (b.pos[0] < view.pos[0] + view.dim[0] and view.pos[0] < b.pos[0] + b.dim[0] and
+					b.pos[1] < view.pos[1] + view.dim[1] and view.pos[1] < b.pos[1] + b.dim[1])
+				{
+					hits += 1;
+				}
+			}
+		}
+		auto scan_us = elapsed_us(t0, reps);
+
+		if (hits != out.size()) {
+			print("ERROR: grid found %|| boxes, scan %||\n", out.size(), hits);
+		}
+
+		// every object drifts by one pixel
+		t0 = Clock::now();
+		for (size_t i = 0; i < n; ++i) {
+			auto b = boxes[i];
+			b.pos[0] = int16_t(b.pos[0] + 1);
+			grid.move(hs[i], b);
+		}
+		auto move_us = elapsed_us(t0, 1);
+
+		print("%|10| %|10| %|12.1f| %|12.1f| %|12.1f|\n", n, out.size(), grid_us, scan_us, move_us);
+	}
+}
+
+struct UploadCase {
+	char const* name;
+	GLenum format;
+	GLenum type;
+	bool storage;   // glTexStorage2D GL_RGBA8, else glTexImage2D
+	int align;
+	bool swizzle;   // count rgba -> bgra on cpu
+};
+
+double upload_mbps(UploadCase const& c, std::vector<uint8_t> const& rgba, v2s dim, int reps) {
+	std::vector<uint8_t> buf(rgba.size());
+	if (c.format != GL_RGBA) {
+		for (size_t i = 0; i < rgba.size(); i += 4) {
+			buf[i+0] = rgba[i+2];
+			buf[i+1] = rgba[i+1];
+			buf[i+2] = rgba[i+0];
+			buf[i+3] = rgba[i+3];
+		}
+	}
+	else {
+		buf = rgba;
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, c.align);
+	glFinish();
+
+	// allocate, upload and release a texture per rep, like make_texture
+	auto t0 = Clock::now();
+	for (int r = 0; r < reps; ++r) {
+		if (c.swizzle) {
+			for (size_t i = 0; i < rgba.size(); i += 4) {
+				buf[i+0] = rgba[i+2];
+				buf[i+1] = rgba[i+1];
+				buf[i+2] = rgba[i+0];
+				buf[i+3] = rgba[i+3];
+			}
+		}
+
+		GLuint id;
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D, id);
+		if (c.storage) {
+			glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, dim[0], dim[1]);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, dim[0], dim[1], c.format, c.type, buf.data());
+		}
+		else {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dim[0], dim[1], 0, c.format, c.type, buf.data());
+		}
+		glFinish();
+		glDeleteTextures(1, &id);
+	}
+	auto us = elapsed_us(t0, reps);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	return double(rgba.size()) / us;
+}
+
+void bench_upload() {
+	Front front;
+	front.init("bench", v2s(320,200));
+
+	auto dim = v2s(1024,1024);
+	int const reps = 50;
+
+	std::mt19937 rng(1);
+	std::vector<uint8_t> rgba(size_t(dim[0]) * size_t(dim[1]) * 4);
+	for (auto & x: rgba) {
+		x = uint8_t(rng());
+	}
+
+	UploadCase const cases[] = {
+		{"teximage rgba align 1", GL_RGBA, GL_UNSIGNED_BYTE, false, 1, false},
+		{"storage rgba", GL_RGBA, GL_UNSIGNED_BYTE, true, 4, false},
+		#ifndef __EMSCRIPTEN__
+		{"storage bgra", GL_BGRA, GL_UNSIGNED_BYTE, true, 4, false},
+		{"storage bgra 8888_rev", GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, true, 4, false},
+		{"storage bgra + swizzle", GL_BGRA, GL_UNSIGNED_BYTE, true, 4, true},
+		#endif
+	};
+
+	print("texture upload: %||x%|| rgba, allocate + upload + glFinish\n", dim[0], dim[1]);
+	print("%|26| %|12|\n", "variant", "MB/s");
+	for (auto & c: cases) {
+		print("%|26| %|12.1f|\n", c.name, upload_mbps(c, rgba, dim, reps));
+	}
+
+	// make_texture path (rgba source)
+	glFinish();
+	auto t0 = Clock::now();
+	for (int r = 0; r < reps; ++r) {
+		auto t = front.make_texture(rgba.data(), dim);
+		glFinish();
+	}
+	print("%|26| %|12.1f|\n", "make_texture", double(rgba.size()) / elapsed_us(t0, reps));
+
+	// render thread time per frame for a background image
+	auto big = v2s(4096,4096);
+	Image img(big);
+	for (int16_t j = 0; j < big[1]; ++j) {
+		for (int16_t i = 0; i < big[0]; ++i) {
+			img({i,j}) = Color(uint8_t(i), uint8_t(j), uint8_t(i ^ j), 255);
+		}
+	}
+
+	glFinish();
+	t0 = Clock::now();
+	{
+		auto t = front.make_texture(img);
+	}
+	auto direct_us = elapsed_us(t0, 1);
+
+	TextureStream stream(front);
+	auto t = front.make_texture(big);
+	glFinish();
+
+	stream.upload(t, std::move(img));
+	double worst_us = 0;
+	int frames = 0;
+	while (stream.busy()) {
+		t0 = Clock::now();
+		stream.update();
+		worst_us = std::max(worst_us, elapsed_us(t0, 1));
+		frames += 1;
+		front.flip();
+	}
+
+	print("texture upload: %||x%|| on render thread\n", big[0], big[1]);
+	print("%|26| %|12| %|8|\n", "variant", "worst us", "frames");
+	print("%|26| %|12.1f| %|8|\n", "make_texture", direct_us, 1);
+	print("%|26| %|12.1f| %|8|\n", "stream", worst_us, frames);
+}
+
+int main(int argc, char* argv[]) {
+	auto which = (argc > 1) ? std::string(argv[1]) : std::string("grid");
+	if (which == "grid") {
+		bench_spatialgrid();
+	}
+	else if (which == "upload") {
+		bench_upload();
+	}
+	else {
+		print(std::cerr, "usage: bench [grid|upload]\n");
+		return 1;
+	}
+	return 0;
+}
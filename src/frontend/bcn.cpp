@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <cmath>
+#include "bcn.hpp"
+
+namespace frontend {
+
+	bool is_compressed_format(GLenum format) {
+		return format == FormatBC1 or format == FormatBC3;
+	}
+
+	size_t get_bc_size(GLenum format, v2s dim) {
+		size_t bw = (size_t(dim[0]) + 3) / 4;
+		size_t bh = (size_t(dim[1]) + 3) / 4;
+		size_t block = (format == FormatBC1) ? 8 : 16;
+		return bw * bh * block;
+	}
+
+	bool has_alpha(Image const& img) {
+		auto d = img.get_dim();
+		for (int16_t j = 0; j < d[1]; ++j) {
+			for (int16_t i = 0; i < d[0]; ++i) {
+				if (img(v2s(i,j)).a != 255) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+
+	uint16_t pack_565(float r, float g, float b) {
+		auto q = [](float x, int n) {
+			return uint16_t(std::min(std::max(int(std::lround(x * n / 255.0f)), 0), n));
+		};
+		return uint16_t((q(r,31) << 11) | (q(g,63) << 5) | q(b,31));
+	}
+
+	Color unpack_565(uint16_t c) {
+		uint8_t r = (c >> 11) & 31;
+		uint8_t g = (c >> 5) & 63;
+		uint8_t b = c & 31;
+		return Color(
+			uint8_t((r << 3) | (r >> 2)),
+			uint8_t((g << 2) | (g >> 4)),
+			uint8_t((b << 3) | (b >> 2)),
+			255
+		);
+	}
+
+	void bc1_palette(Color * pal, uint16_t c0, uint16_t c1) {
+		pal[0] = unpack_565(c0);
+		pal[1] = unpack_565(c1);
+		if (c0 > c1) {
+			pal[2] = Color(
+				uint8_t((2*pal[0].r + pal[1].r) / 3),
+				uint8_t((2*pal[0].g + pal[1].g) / 3),
+				uint8_t((2*pal[0].b + pal[1].b) / 3),
+				255
+			);
+			pal[3] = Color(
+				uint8_t((pal[0].r + 2*pal[1].r) / 3),
+				uint8_t((pal[0].g + 2*pal[1].g) / 3),
+				uint8_t((pal[0].b + 2*pal[1].b) / 3),
+				255
+			);
+		}
+		else {
+			pal[2] = Color(
+				uint8_t((pal[0].r + pal[1].r) / 2),
+				uint8_t((pal[0].g + pal[1].g) / 2),
+				uint8_t((pal[0].b + pal[1].b) / 2),
+				255
+			);
+			pal[3] = Color(0,0,0,0);
+		}
+	}
+
+	int color_dist(Color x, Color y) {
+		int dr = int(x.r) - int(y.r);
+		int dg = int(x.g) - int(y.g);
+		int db = int(x.b) - int(y.b);
+		return dr*dr + dg*dg + db*db;
+	}
+
+	void put_u16(uint8_t * p, uint16_t x) {
+		p[0] = uint8_t(x);
+		p[1] = uint8_t(x >> 8);
+	}
+
+	uint16_t get_u16(uint8_t const* p) {
+		return uint16_t(p[0] | (p[1] << 8));
+	}
+
+
+	void encode_bc1_block(uint8_t * out, Color const* px, bool use_alpha) {
+		// pixels that matter for colour; transparent ones are ignored with alpha
+		int sel[16];
+		int n = 0;
+		for (int i = 0; i < 16; ++i) {
+			if (not use_alpha or px[i].a != 0) {
+				sel[n++] = i;
+			}
+		}
+		if (n == 0) {
+			for (int i = 0; i < 16; ++i) sel[i] = i;
+			n = 16;
+		}
+
+		// mean and covariance
+		float m[3] = {0,0,0};
+		for (int k = 0; k < n; ++k) {
+			auto c = px[sel[k]];
+			m[0] += c.r; m[1] += c.g; m[2] += c.b;
+		}
+		for (auto & x: m) x /= n;
+
+		float cov[6] = {0,0,0,0,0,0};
+		for (int k = 0; k < n; ++k) {
+			auto c = px[sel[k]];
+			float r = c.r - m[0], g = c.g - m[1], b = c.b - m[2];
+			cov[0] += r*r; cov[1] += r*g; cov[2] += r*b;
+			cov[3] += g*g; cov[4] += g*b; cov[5] += b*b;
+		}
+
+		// principal axis by power iteration, seeded with the channel of
+		// largest variance (a grey seed is orthogonal to e.g. red-green)
+		float ax[3] = {0,0,0};
+		float var[3] = {cov[0], cov[3], cov[5]};
+		ax[std::max_element(var, var + 3) - var] = 1;
+		bool collapsed = false;
+		for (int it = 0; it < 8; ++it) {
+			float x = cov[0]*ax[0] + cov[1]*ax[1] + cov[2]*ax[2];
+			float y = cov[1]*ax[0] + cov[3]*ax[1] + cov[4]*ax[2];
+			float z = cov[2]*ax[0] + cov[4]*ax[1] + cov[5]*ax[2];
+			float len = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+			if (len < 1e-6f) {
+				collapsed = true;
+				break;
+			}
+			ax[0] = x/len; ax[1] = y/len; ax[2] = z/len;
+		}
+
+		// fallback: bounding box diagonal
+		if (collapsed) {
+			uint8_t lo[3] = {255,255,255}, hi[3] = {0,0,0};
+			for (int k = 0; k < n; ++k) {
+				auto c = px[sel[k]];
+				uint8_t v[3] = {c.r, c.g, c.b};
+				for (int i = 0; i < 3; ++i) {
+					lo[i] = std::min(lo[i], v[i]);
+					hi[i] = std::max(hi[i], v[i]);
+				}
+			}
+			for (int i = 0; i < 3; ++i) {
+				ax[i] = float(hi[i] - lo[i]);
+			}
+		}
+
+		// extreme pixels along axis
+		float tmin = 1e9f, tmax = -1e9f;
+		for (int k = 0; k < n; ++k) {
+			auto c = px[sel[k]];
+			float t = (c.r - m[0])*ax[0] + (c.g - m[1])*ax[1] + (c.b - m[2])*ax[2];
+			tmin = std::min(tmin, t);
+			tmax = std::max(tmax, t);
+		}
+		float len2 = ax[0]*ax[0] + ax[1]*ax[1] + ax[2]*ax[2];
+		if (len2 > 0) {
+			tmin /= len2;
+			tmax /= len2;
+		}
+
+		uint16_t c0 = pack_565(m[0] + ax[0]*tmax, m[1] + ax[1]*tmax, m[2] + ax[2]*tmax);
+		uint16_t c1 = pack_565(m[0] + ax[0]*tmin, m[1] + ax[1]*tmin, m[2] + ax[2]*tmin);
+
+		// 4-colour mode needs c0 > c1
+		if (c0 < c1) {
+			std::swap(c0, c1);
+		}
+
+		uint32_t idx = 0;
+		if (c0 != c1) {
+			Color pal[4];
+			bc1_palette(pal, c0, c1);
+			for (int i = 0; i < 16; ++i) {
+				int best = 0;
+				int best_d = color_dist(px[i], pal[0]);
+				for (int p = 1; p < 4; ++p) {
+					int d = color_dist(px[i], pal[p]);
+					if (d < best_d) {
+						best_d = d;
+						best = p;
+					}
+				}
+				idx |= uint32_t(best) << (2*i);
+			}
+		}
+
+		put_u16(out + 0, c0);
+		put_u16(out + 2, c1);
+		put_u16(out + 4, uint16_t(idx));
+		put_u16(out + 6, uint16_t(idx >> 16));
+	}
+
+	void bc3_alpha_palette(uint8_t * pal, uint8_t a0, uint8_t a1) {
+		pal[0] = a0;
+		pal[1] = a1;
+		if (a0 > a1) {
+			for (int i = 1; i < 7; ++i) {
+				pal[1+i] = uint8_t(((7-i)*a0 + i*a1) / 7);
+			}
+		}
+		else {
+			for (int i = 1; i < 5; ++i) {
+				pal[1+i] = uint8_t(((5-i)*a0 + i*a1) / 5);
+			}
+			pal[6] = 0;
+			pal[7] = 255;
+		}
+	}
+
+	void encode_bc3_alpha_block(uint8_t * out, Color const* px) {
+		uint8_t a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; ++i) {
+			a0 = std::max(a0, px[i].a);
+			a1 = std::min(a1, px[i].a);
+		}
+
+		uint64_t idx = 0;
+		if (a0 != a1) {
+			uint8_t pal[8];
+			bc3_alpha_palette(pal, a0, a1);
+			for (int i = 0; i < 16; ++i) {
+				int best = 0;
+				int best_d = 256;
+				for (int p = 0; p < 8; ++p) {
+					int d = std::abs(int(px[i].a) - int(pal[p]));
+					if (d < best_d) {
+						best_d = d;
+						best = p;
+					}
+				}
+				idx |= uint64_t(best) << (3*i);
+			}
+		}
+
+		out[0] = a0;
+		out[1] = a1;
+		for (int i = 0; i < 6; ++i) {
+			out[2+i] = uint8_t(idx >> (8*i));
+		}
+	}
+
+	void decode_bc1_block(Color * px, uint8_t const* in) {
+		auto c0 = get_u16(in + 0);
+		auto c1 = get_u16(in + 2);
+		uint32_t idx = uint32_t(get_u16(in + 4)) | (uint32_t(get_u16(in + 6)) << 16);
+
+		Color pal[4];
+		bc1_palette(pal, c0, c1);
+		for (int i = 0; i < 16; ++i) {
+			px[i] = pal[(idx >> (2*i)) & 3];
+		}
+	}
+
+	void decode_bc3_alpha_block(Color * px, uint8_t const* in) {
+		uint8_t pal[8];
+		bc3_alpha_palette(pal, in[0], in[1]);
+
+		uint64_t idx = 0;
+		for (int i = 0; i < 6; ++i) {
+			idx |= uint64_t(in[2+i]) << (8*i);
+		}
+		for (int i = 0; i < 16; ++i) {
+			px[i].a = pal[(idx >> (3*i)) & 7];
+		}
+	}
+
+
+	void encode_bc(std::vector<uint8_t> & out, GLenum format, Image const& img) {
+		assert(is_compressed_format(format));
+
+		auto d = img.get_dim();
+		size_t block = (format == FormatBC1) ? 8 : 16;
+
+		out.resize(get_bc_size(format, d));
+		auto p = out.data();
+
+		Color px[16];
+		for (int16_t by = 0; by < d[1]; by += 4) {
+			for (int16_t bx = 0; bx < d[0]; bx += 4) {
+				// gather block, clamp at edges
+				for (int j = 0; j < 4; ++j) {
+					for (int i = 0; i < 4; ++i) {
+						int16_t x = std::min<int16_t>(bx + i, d[0] - 1);
+						int16_t y = std::min<int16_t>(by + j, d[1] - 1);
+						px[j*4 + i] = img(v2s(x,y));
+					}
+				}
+
+				if (format == FormatBC1) {
+					encode_bc1_block(p, px, false);
+				}
+				else {
+					encode_bc3_alpha_block(p, px);
+					encode_bc1_block(p + 8, px, true);
+				}
+				p += block;
+			}
+		}
+	}
+
+	void decode_bc(uint8_t * rgba, GLenum format, uint8_t const* blocks, v2s dim) {
+		assert(is_compressed_format(format));
+
+		size_t block = (format == FormatBC1) ? 8 : 16;
+		auto p = blocks;
+		auto out = (Color*)rgba;
+
+		Color px[16];
+		for (int16_t by = 0; by < dim[1]; by += 4) {
+			for (int16_t bx = 0; bx < dim[0]; bx += 4) {
+				if (format == FormatBC1) {
+					decode_bc1_block(px, p);
+				}
+				else {
+					decode_bc1_block(px, p + 8);
+					decode_bc3_alpha_block(px, p);
+				}
+				p += block;
+
+				for (int j = 0; j < 4 and by + j < dim[1]; ++j) {
+					for (int i = 0; i < 4 and bx + i < dim[0]; ++i) {
+						out[size_t(by + j) * dim[0] + (bx + i)] = px[j*4 + i];
+					}
+				}
+			}
+		}
+	}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include "front.hpp"
+
+namespace frontend {
+
+	/*
+		S3TC block compression (BC1 = DXT1, BC3 = DXT5).
+
+		4x4 pixel blocks; BC1 stores 8 bytes per block (rgb, opaque),
+		BC3 stores 16 bytes per block (bc1 colour + interpolated alpha).
+		Edge blocks of images not divisible by 4 repeat the last row/column.
+	*/
+
+	GLenum const FormatBC1 = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	GLenum const FormatBC3 = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+	bool is_compressed_format(GLenum format);
+
+	// bytes of compressed image
+	size_t get_bc_size(GLenum format, v2s dim);
+
+	// true if any pixel is not opaque
+	bool has_alpha(Image const& img);
+
+	void encode_bc(std::vector<uint8_t> & out, GLenum format, Image const& img);
+
+	// decode into rgba buffer of dim[0]*dim[1]*4 bytes
+	void decode_bc(uint8_t * rgba, GLenum format, uint8_t const* blocks, v2s dim);
+
+	void encode_bc1_block(uint8_t * out, Color const* px, bool use_alpha);
+	void encode_bc3_alpha_block(uint8_t * out, Color const* px);
+	void decode_bc1_block(Color * px, uint8_t const* in);
+	void decode_bc3_alpha_block(Color * px, uint8_t const* in);
+
+}
@@ -0,0 +1,73 @@
+#include "dirtyrect.hpp"
+#include <algorithm>
+#include <climits>
+
+namespace frontend {
+
+	int32_t box_area(b2s a) {
+		return int32_t(a.dim[0]) * int32_t(a.dim[1]);
+	}
+
+	b2s box_union(b2s a, b2s b) {
+		auto x0 = std::min(a.pos[0], b.pos[0]);
+		auto y0 = std::min(a.pos[1], b.pos[1]);
+		auto x1 = std::max(a.pos[0] + a.dim[0], b.pos[0] + b.dim[0]);
+		auto y1 = std::max(a.pos[1] + a.dim[1], b.pos[1] + b.dim[1]);
+		return b2s(v2s(x0, y0), v2s(x1 - x0, y1 - y0));
+	}
+
+	bool box_touch(b2s a, b2s b) {
+		// overlapping or adjacent
+		return
+			a.pos[0] <= b.pos[0] + b.dim[0] and b.pos[0] <= a.pos[0] + a.dim[0] and
+			a.pos[1] <= b.pos[1] + b.dim[1] and b.pos[1] <= a.pos[1] + a.dim[1];
+	}
+
+	void DirtyRect::add(b2s box) {
+		if (box.dim[0] <= 0 or box.dim[1] <= 0) {
+			return;
+		}
+
+		// merge touching boxes; merged box may now touch others
+		int i = 0;
+		while (i < count) {
+			if (box_touch(rects[i], box)) {
+				box = box_union(rects[i], box);
+				rects[i] = rects[count-1];
+				--count;
+				i = 0;
+				continue;
+			}
+			++i;
+		}
+
+		if (count < max_rects) {
+			rects[count++] = box;
+			return;
+		}
+
+		// full: merge with cheapest
+		int best = 0;
+		int32_t best_cost = INT32_MAX;
+		for (int i = 0; i < count; ++i) {
+			auto cost = box_area(box_union(rects[i], box)) - box_area(rects[i]);
+			if (cost < best_cost) {
+				best_cost = cost;
+				best = i;
+			}
+		}
+		rects[best] = box_union(rects[best], box);
+	}
+
+	b2s DirtyRect::get_bounds() const {
+		if (count == 0) {
+			return b2s(v2s(0,0), v2s(0,0));
+		}
+		auto r = rects[0];
+		for (int i = 1; i < count; ++i) {
+			r = box_union(r, rects[i]);
+		}
+		return r;
+	}
+
+}
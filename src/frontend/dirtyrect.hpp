@@ -0,0 +1,30 @@
+#pragma once
+#include "front.hpp"
+
+namespace frontend {
+
+	struct DirtyRect {
+		/*
+			Accumulates changed regions of an Image.
+			Keeps at most max_rects boxes; when full, the new box is merged
+			into the one whose bounding box grows the least.
+		*/
+
+		static int const max_rects = 4;
+
+		b2s rects[max_rects];
+		int count{0};
+
+		void add(b2s box);
+		void clear() { count = 0; }
+		bool empty() const { return count == 0; }
+
+		// bounding box of all regions
+		b2s get_bounds() const;
+	};
+
+	b2s box_union(b2s a, b2s b);
+	int32_t box_area(b2s a);
+	bool box_touch(b2s a, b2s b);
+
+}
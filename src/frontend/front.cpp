@@ -1,14 +1,18 @@
+#include <algorithm>
 #include "front.hpp"
 
 #include "../lodepng/lodepng.h"
 #include "my.hpp"
 #include "shader.hpp"
+#include "dirtyrect.hpp"
+#include "pack.hpp"
+#include "bcn.hpp"
+#include "radix.hpp"
+#include "staticlayer.hpp"
 
 namespace frontend {
 
 
-	using geo2::vdiv;
-
 	void init_glew() {
 		// GL_INVALUD_ENUM bug
 		glewExperimental=GL_TRUE;
@@ -82,21 +86,204 @@ namespace frontend {
 		return r;
 	}
 
-	Texture Front::make_texture(uint8_t const* rgba, v2s dim) {
+	bool load_png_indexed(IndexedImage & out, filesys::Path const& path)
+	{
+		std::vector<uint8_t> png;
+		lodepng::load_file(png, path);
+
+		// keep png colour mode as is
+		lodepng::State state;
+		state.decoder.color_convert = 0;
+
+		std::vector<uint8_t> raw;
+		unsigned width, height;
+		unsigned err = lodepng::decode(raw, width, height, state, png);
+		if (err) {
+			ext::fail("ERROR: lodepng: %||: %||\n", lodepng_error_text(err), path);
+		}
+
+		auto & mode = state.info_png.color;
+		if (mode.colortype != LCT_PALETTE) {
+			return false;
+		}
+
+		out.dim = v2s(width, height);
+		out.index.resize(size_t(width) * size_t(height));
+		out.palette.resize(mode.palettesize);
+		for (size_t i = 0; i < mode.palettesize; ++i) {
+			auto p = mode.palette + 4*i;
+			out.palette[i] = Color(p[0], p[1], p[2], p[3]);
+		}
+
+		// unpack 1,2,4 bit pixels; lodepng raw rows are not padded
+		unsigned bits = mode.bitdepth;
+		unsigned mask = (1u << bits) - 1;
+		for (size_t k = 0; k < out.index.size(); ++k) {
+			size_t bit = k * bits;
+			unsigned shift = 8 - bits - (bit & 7);
+			out.index[k] = uint8_t((raw[bit >> 3] >> shift) & mask);
+		}
+
+		return true;
+	}
+
+	bool is_mask(Image const& img, Color ignore) {
+		auto d = img.get_dim();
+		for (int16_t j = 0; j < d[1]; ++j) {
+			for (int16_t i = 0; i < d[0]; ++i) {
+				auto c = img(v2s(i,j));
+				if (c == ignore) {
+					continue;
+				}
+				if (c.r != c.a or c.g != c.a or c.b != c.a) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	std::vector<uint8_t> to_mask(Image const& img, Color ignore) {
+		auto d = img.get_dim();
+		std::vector<uint8_t> r(size_t(d[0]) * size_t(d[1]));
+		auto p = r.data();
+		for (int16_t j = 0; j < d[1]; ++j) {
+			for (int16_t i = 0; i < d[0]; ++i) {
+				auto c = img(v2s(i,j));
+				*p++ = (c == ignore) ? 0 : c.a;
+			}
+		}
+		return r;
+	}
+
+	int get_mip_levels(v2s dim) {
+		int levels = 1;
+		for (int d = std::max(dim[0], dim[1]); d > 1; d /= 2) {
+			levels += 1;
+		}
+		return levels;
+	}
+
+	Texture Front::make_mask_texture(uint8_t const* mask, v2s dim, TexOpts opts) {
+		#ifdef __EMSCRIPTEN__
+			// webgl has no texture swizzle; expand to rgba
+			std::vector<Color> rgba(size_t(dim[0]) * size_t(dim[1]));
+			for (size_t i = 0; i < rgba.size(); ++i) {
+				auto v = mask[i];
+				rgba[i] = Color(255, 255, 255, v);
+			}
+			return make_texture((uint8_t const*)rgba.data(), dim, opts);
+		#endif
 
 		Texture t;
 		t.create();
-		
+
 		t.dim = dim;
-		
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		t.format = GL_R8;
+		t.levels = uint8_t((opts & TexMipmap) ? get_mip_levels(dim) : 1);
+
+		glBindTexture(GL_TEXTURE_2D, t.id);
+		CHECK_GL();
+
+		glTexStorage2D(GL_TEXTURE_2D, t.levels, GL_R8, dim[0], dim[1]);
+		CHECK_GL();
+
+		// single byte rows are packed
+		glPixelStorei(GL_UNPACK_ALIGNMENT, (dim[0] % 4 == 0) ? 4 : 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, dim[0], dim[1], GL_RED, GL_UNSIGNED_BYTE, mask);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		CHECK_GL();
+
+		if (t.levels > 1) {
+			glGenerateMipmap(GL_TEXTURE_2D);
+			CHECK_GL();
+		}
+
+		// red -> (1,1,1,red), white with coverage as alpha; tinted in shader
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_ONE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_ONE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_ONE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_RED);
+		CHECK_GL();
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		CHECK_GL();
+
+		return t;
+	}
+
+	void Front::upload_pixels(v2s pos, v2s dim, uint8_t const* px, int16_t stride, GLenum format) {
+		assert(format == GL_RGBA or (format == FormatBGRA and has_bgra));
+
+		// rows of 4-byte pixels are always 4-byte aligned
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, pos[0], pos[1], dim[0], dim[1], format, GL_UNSIGNED_BYTE, px);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		CHECK_GL();
+	}
+
+	Texture Front::make_texture(uint8_t const* rgba, v2s dim, TexOpts opts, GLenum format) {
+		Texture t;
+		t.create();
+
+		t.dim = dim;
+		t.levels = uint8_t((opts & TexMipmap) ? get_mip_levels(dim) : 1);
+
+		glBindTexture(GL_TEXTURE_2D, t.id);
+		CHECK_GL();
+
+		// immutable storage in sized format, no reallocation checks later
+		glTexStorage2D(GL_TEXTURE_2D, t.levels, GL_RGBA8, dim[0], dim[1]);
+		CHECK_GL();
+
+		upload_pixels(v2s(0,0), dim, rgba, dim[0], format);
+
+		if (t.levels > 1) {
+			glGenerateMipmap(GL_TEXTURE_2D);
+			CHECK_GL();
+		}
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 		CHECK_GL();
 
+		return t;
+	}
+
+
+	size_t get_texture_bytes(GLenum format, v2s dim) {
+		if (is_compressed_format(format)) {
+			return get_bc_size(format, dim);
+		}
+		if (format == GL_R8) {
+			return size_t(dim[0]) * size_t(dim[1]);
+		}
+		return size_t(dim[0]) * size_t(dim[1]) * 4;
+	}
+
+	Texture Front::make_compressed_texture(GLenum format, uint8_t const* blocks, v2s dim) {
+		if (not has_bc) {
+			// fallback: decompress on cpu
+			std::vector<uint8_t> rgba(size_t(dim[0]) * size_t(dim[1]) * 4);
+			decode_bc(rgba.data(), format, blocks, dim);
+			return make_texture(rgba.data(), dim);
+		}
+
+		Texture t;
+		t.create();
+
+		t.dim = dim;
+		t.format = format;
+
 		glBindTexture(GL_TEXTURE_2D, t.id);
 		CHECK_GL();
 
-			
-		glTexImage2D(GL_TEXTURE_2D, 0, t.format, dim[0], dim[1], 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+		glTexStorage2D(GL_TEXTURE_2D, 1, format, dim[0], dim[1]);
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, dim[0], dim[1], format,
+			GLsizei(get_bc_size(format, dim)), blocks
+		);
 		CHECK_GL();
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -106,17 +293,265 @@ namespace frontend {
 		return t;
 	}
 
+	Texture Front::make_palette(std::vector<Color> const& colors) {
+		assert(colors.size() <= 256);
 
-	
+		// unused entries transparent
+		std::vector<Color> pal(256, Color(0,0,0,0));
+		std::copy(colors.begin(), colors.end(), pal.begin());
+		return make_texture((uint8_t const*)pal.data(), v2s(256,1));
+	}
+
+	void Front::update_palette(Texture & palette, std::vector<Color> const& colors) {
+		assert(colors.size() <= 256);
+		assert(palette.dim == v2s(256,1));
+
+		flush_if_sampled(palette.id);
+
+		glBindTexture(GL_TEXTURE_2D, palette.id);
+		CHECK_GL();
+
+		upload_pixels(v2s(0,0), v2s(int16_t(colors.size()), 1), (uint8_t const*)colors.data(), int16_t(colors.size()));
+	}
+
+	IndexedTexture Front::make_indexed_texture(IndexedImage const& img) {
+		IndexedTexture r;
+		r.palette = make_palette(img.palette);
+
+		auto & t = r.index;
+		t.create();
+
+		t.dim = img.dim;
+		t.format = GL_R8;
+
+		glBindTexture(GL_TEXTURE_2D, t.id);
+		CHECK_GL();
+
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, img.dim[0], img.dim[1]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, (img.dim[0] % 4 == 0) ? 4 : 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, img.dim[0], img.dim[1], GL_RED, GL_UNSIGNED_BYTE, img.index.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		CHECK_GL();
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		CHECK_GL();
+
+		return r;
+	}
+
+	IndexedTexture Front::make_indexed_texture(filesys::Path const& path) {
+		IndexedImage img;
+		if (not load_png_indexed(img, path)) {
+			ext::fail("ERROR: make_indexed_texture: not a palette image: %||\n", path);
+		}
+		return make_indexed_texture(img);
+	}
+
+	int16_t round_pow2(int16_t x) {
+		assert(x <= 16384);
+		int16_t r = 16;
+		while (r < x) r *= 2;
+		return r;
+	}
+
+	Texture Front::make_array_texture(Image const& img) {
+		auto d = img.get_dim();
+		if (d[0] > 16384 or d[1] > 16384) {
+			return make_texture(img);
+		}
+		auto pd = v2s(round_pow2(d[0]), round_pow2(d[1]));
+
+		size_t layer_bytes = size_t(pd[0]) * size_t(pd[1]) * 4;
+		size_t layers = std::min<size_t>(array_layers, array_page_bytes / layer_bytes);
+		if (layers < 4) {
+			return make_texture(img);
+		}
+
+		// find page with free layer
+		TextureArray * a = nullptr;
+		for (auto & x: arrays) {
+			if (x.tex.dim == pd and x.used < layers) {
+				a = &x;
+				break;
+			}
+		}
+
+		if (not a) {
+			arrays.emplace_back();
+			a = &arrays.back();
+
+			auto & t = a->tex;
+			t.create();
+			t.dim = pd;
+			t.target = GL_TEXTURE_2D_ARRAY;
+			t.page = pd;
+
+			glBindTexture(GL_TEXTURE_2D_ARRAY, t.id);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			CHECK_GL();
+
+			grow_array(*a, array_first_layers);
+		}
+		else if (a->used == a->capacity) {
+			grow_array(*a, uint16_t(std::min<size_t>(2 * a->capacity, layers)));
+		}
+
+		auto layer = a->used++;
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, a->tex.id);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		CHECK_GL();
+
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, d[0], d[1], 1,
+			GL_RGBA, GL_UNSIGNED_BYTE, &img({0,0})
+		);
+		CHECK_GL();
+
+		// view of layer, at texel origin
+		Texture t;
+		t.id = a->tex.id;
+		t.dim = d;
+		t.target = GL_TEXTURE_2D_ARRAY;
+		t.layer = layer;
+		t.page = pd;
+		t.owner = false;
+		return t;
+	}
+
+	void Front::grow_array(TextureArray & a, uint16_t capacity) {
+		// views hold the page id, so storage is respecified in place
+		// (mutable) with used layers saved through a scratch array
+		auto pd = a.tex.page;
+
+		GLuint fbo, tmp = 0;
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		CHECK_GL();
+
+		auto copy_layers = [&](GLuint src, GLuint dst) {
+			glBindTexture(GL_TEXTURE_2D_ARRAY, dst);
+			for (uint16_t i = 0; i < a.used; ++i) {
+				glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, src, 0, i);
+				glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, 0, 0, pd[0], pd[1]);
+			}
+			CHECK_GL();
+		};
+
+		if (a.used > 0) {
+			glGenTextures(1, &tmp);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, tmp);
+			glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, pd[0], pd[1], a.used);
+			CHECK_GL();
+			copy_layers(a.tex.id, tmp);
+		}
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, a.tex.id);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, pd[0], pd[1], capacity, 0,
+			GL_RGBA, GL_UNSIGNED_BYTE, nullptr
+		);
+		CHECK_GL();
+		a.capacity = capacity;
+
+		if (tmp) {
+			copy_layers(tmp, a.tex.id);
+			glDeleteTextures(1, &tmp);
+		}
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &fbo);
+		CHECK_GL();
+	}
+
+	Texture Front::make_texture(v2s dim) {
+		Texture t;
+		t.create();
+
+		t.dim = dim;
+
+		glBindTexture(GL_TEXTURE_2D, t.id);
+		CHECK_GL();
+
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, dim[0], dim[1]);
+		CHECK_GL();
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		CHECK_GL();
+
+		return t;
+	}
+
+	void Front::update_texture(Texture & t, Image const& img, b2s region) {
+		if (upload_region(t, img, region) and t.levels > 1) {
+			glGenerateMipmap(GL_TEXTURE_2D);
+			CHECK_GL();
+		}
+	}
+
+	bool Front::upload_region(Texture const& t, Image const& img, b2s region) {
+		// leaves t bound when anything was uploaded
+		auto d = img.get_dim();
+		assert(d == t.dim);
+		assert(t.target == GL_TEXTURE_2D);  // not for array layer views
+		assert(t.format == GL_RGBA);  // rgba rows; not masks, indices or blocks
+
+		// clip to image
+		int16_t x0 = std::max<int16_t>(region.pos[0], 0);
+		int16_t y0 = std::max<int16_t>(region.pos[1], 0);
+		int16_t x1 = std::min<int16_t>(region.pos[0] + region.dim[0], d[0]);
+		int16_t y1 = std::min<int16_t>(region.pos[1] + region.dim[1], d[1]);
+		if (x0 >= x1 or y0 >= y1) {
+			return false;
+		}
+
+		flush_if_sampled(t.id);
+
+		glBindTexture(GL_TEXTURE_2D, t.id);
+		CHECK_GL();
+
+		// source rows are full image rows
+		upload_pixels(v2s(x0, y0), v2s(int16_t(x1 - x0), int16_t(y1 - y0)), (uint8_t const*)&img({x0,y0}), d[0]);
+		return true;
+	}
+
+	void Front::update_texture(Texture & t, Image const& img, DirtyRect & dirty) {
+		bool any = false;
+		for (int i = 0; i < dirty.count; ++i) {
+			any = upload_region(t, img, dirty.rects[i]) or any;
+		}
+		dirty.clear();
 
+		// mips once for all rects
+		if (any and t.levels > 1) {
+			glBindTexture(GL_TEXTURE_2D, t.id);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			CHECK_GL();
+		}
+	}
 
-	Texture Front::make_texture(Image const& img) {
+	Texture Front::make_texture(Image const& img, TexOpts opts) {
 		auto data = (uint8_t*)&img({0,0});
-		return make_texture(data, img.get_dim());
+		return make_texture(data, img.get_dim(), opts);
 	}
 
-	Texture Front::make_texture(filesys::Path const& path) {
-		return make_texture(load_png(path));
+	Texture Front::make_texture(filesys::Path const& path, TexOpts opts) {
+		if (pack) {
+			if (auto e = pack->find(path)) {
+				return pack->make_texture(*this, *e, opts);
+			}
+		}
+		auto img = load_png(path);
+		if (opts & TexArray) {
+			return make_array_texture(img);
+		}
+		if ((opts & TexMask) and is_mask(img, Color(0,0,0,0))) {
+			auto mask = to_mask(img, Color(0,0,0,0));
+			return make_mask_texture(mask.data(), img.get_dim(), opts);
+		}
+		return make_texture(img, opts);
 	}
 
 	void Texture::create() {
@@ -126,11 +561,54 @@ namespace frontend {
 	}
 
 	void Texture::destroy() {
+		assert(owner);
+		assert(not is_texture_used(id));
 		glDeleteTextures(1, &id);	
 		CHECK_GL();
 		id = 0;  // ?	
 	}
 
+	struct TextureUser {
+		void const* user;
+		TextureUseFn uses;
+	};
+
+	std::vector<TextureUser> & get_texture_users() {
+		static std::vector<TextureUser> users;
+		return users;
+	}
+
+	void add_texture_user(void const* user, TextureUseFn uses) {
+		get_texture_users().push_back(TextureUser{user, uses});
+	}
+
+	void remove_texture_user(void const* user) {
+		auto & us = get_texture_users();
+		us.erase(std::remove_if(us.begin(), us.end(), [&](TextureUser const& u) {
+			return u.user == user;
+		}), us.end());
+	}
+
+	bool is_texture_used(GLuint id) {
+		for (auto & u: get_texture_users()) {
+			if (u.uses(u.user, id)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool Front::uses_texture(GLuint id) const {
+		return id < sampled.size() and sampled[id] == sampled_gen;
+	}
+
+	void Front::flush_if_sampled(GLuint id) {
+		// pending quads must see the old contents; others keep batching
+		if (uses_texture(id)) {
+			flush();
+		}
+	}
+
 
 
 
@@ -157,134 +635,886 @@ namespace frontend {
 
 
 	void Front::render_texture(Texture const& t, v2s trg, b2s src, Color fg) {
-		set_blend_font(fg);
-		render_subtexture(t,trg,src);
+		render_subtexture(t, 0, trg, src, fg);
 	}
 
+	void Front::render_texture(IndexedTexture const& t, v2s trg, b2s src) {
+		render_texture(t, trg, src, t.palette);
+	}
 
-	void Front::set_blend_font(Color c) {
-		auto v = ColorFloat(c);
-		glBlendColor(v.r, v.g, v.b, v.a);
-		glBlendFuncSeparate(GL_CONSTANT_COLOR, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glBlendEquation(GL_FUNC_ADD);
-		glEnable(GL_BLEND);
+	void Front::render_texture(IndexedTexture const& t, v2s trg, b2s src, Texture const& palette) {
+		render_subtexture(t.index, palette.id, trg, src, Color(255,255,255,255));
 	}
 
-	void Front::set_blend_norm() {
-		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glBlendEquation(GL_FUNC_ADD);
-		glEnable(GL_BLEND);
+	void Front::render_fill(b2s box, Color c) {
+		auto t_end = v2s(box.pos + box.dim);
+
+		push_quad(white1x1, 0, box.pos, t_end, v2s(0,0), v2s(1,1), c);
 	}
 
-	
-	/*void Front::render_texture(Texture const& t, b2s trg, b2s src, Color fg) {
-		set_blend_font(fg);
-		
-		
-	}*/
+	void Front::render_subtexture(Texture const& t, GLuint pal, v2s trg, b2s src, Color c) {
 
-	void Front::render_fill(b2s box, Color c) {
-		set_blend_font(c);
+		auto t_end = v2s(trg + src.dim);
+		auto rs_end = v2s(src.pos + src.dim);
 
-		auto t_pos = v2f(box.pos);
-		auto t_end = v2f(box.pos + box.dim);
-		
-		// quad as triangle fan x,y + u,v
-		GLfloat data[] = {
-			t_pos[0], t_pos[1],  0.0f, 0.0f,
-			t_pos[0], t_end[1],  0.0f, 1.0f, 
-			t_end[0], t_end[1],  1.0f, 1.0f,
-			t_end[0], t_pos[1],  1.0f, 0.0f,
+		// texel coords, normalized in vert0
+		push_quad(t, pal, trg, t_end, src.pos, rs_end, c);
+	}
+
+	uint64_t const KeySeqMask = 0xffffffffu;
+
+	Quad make_quad(Texture const& t, GLuint pal, v2s pos, v2s end, v2s uv0, v2s uv1, Color c) {
+		Quad q;
+		q.tex = t.id;
+		q.pal = pal;
+		q.target = t.target;
+		q.layer = t.layer;
+		q.tex_dim = t.get_store_dim();
+		q.pos = pos;
+		q.end = end;
+		q.uv0 = uv0;
+		q.uv1 = uv1;
+		q.tint = c;
+		q.off0 = v2s(0,0);
+		q.off1 = v2s(0,0);
+		q.rot = 0;
+		q.shape = false;
+		q.line = 0;
+		q.mips = t.levels > 1;
+		q.padded = not (t.get_store_dim() == t.dim);
+		q.sampler = SampNearest;
+		return q;
+	}
+
+	SamplerOpts fit_sampler(SamplerOpts s, Quad const& q) {
+		if (q.pal or q.shape) {
+			return SampNearest;
+		}
+		if (q.padded) {
+			// repeat would tile the page, not the image
+			s = SamplerOpts(s & ~SampRepeat);
+		}
+		return q.mips ? s : SamplerOpts(s & ~SampMipmap);
+	}
+
+	void Front::set_layer_sorted(uint8_t layer, bool sorted) {
+		layer_sorted[layer] = sorted;
+	}
+
+	// cut span a..b to lo..hi, moving u0..u1 along
+	static bool clip_span(int32_t lo, int32_t hi, int32_t & a, int32_t & b, int16_t & u0, int16_t & u1) {
+		lo = std::max(a, lo);
+		hi = std::min(b, hi);
+		if (lo >= hi) {
+			return false;
+		}
+		if (lo == a and hi == b) {
+			return true;
+		}
+
+		// texels per pixel may differ from 1 (fills)
+		int64_t t0 = u0, t1 = u1;
+		int64_t len = b - a;
+		u0 = int16_t(t0 + (lo - a) * (t1 - t0) / len);
+		u1 = int16_t(t0 + (hi - a) * (t1 - t0) / len);
+		a = lo;
+		b = hi;
+		return true;
+	}
+
+	bool clip_quad(b2s clip, v2s & pos, v2s & end, v2s & uv0, v2s & uv1) {
+		for (int k = 0; k < 2; ++k) {
+			int32_t a = pos[k], b = end[k];
+			if (not clip_span(clip.pos[k], int32_t(clip.pos[k]) + clip.dim[k], a, b, uv0[k], uv1[k])) {
+				return false;
+			}
+			pos[k] = int16_t(a);
+			end[k] = int16_t(b);
+		}
+		return true;
+	}
+
+	bool view_quad(v2s view, v2s dim, bool clip, v2s & pos, v2s & end, v2s & uv0, v2s & uv1) {
+		// world and view may be more than 32k apart, subtract in int32
+		int32_t p[2], e[2];
+		bool cut = false;
+		for (int k = 0; k < 2; ++k) {
+			p[k] = int32_t(pos[k]) - view[k];
+			e[k] = int32_t(end[k]) - view[k];
+			if (e[k] <= 0 or p[k] >= dim[k]) {
+				return false;
+			}
+			// cut when asked or when context coords leave int16
+			if (clip) {
+				cut = cut or p[k] < 0 or e[k] > dim[k];
+			}
+			else {
+				cut = cut or p[k] < INT16_MIN or e[k] > INT16_MAX;
+			}
+		}
+		for (int k = 0; k < 2; ++k) {
+			if (cut) {
+				clip_span(0, dim[k], p[k], e[k], uv0[k], uv1[k]);
+			}
+			pos[k] = int16_t(p[k]);
+			end[k] = int16_t(e[k]);
+		}
+		return true;
+	}
+
+	void Front::push_clip(b2s box, bool scissor) {
+		if (not clips.empty()) {
+			auto & top = clips.back().box;
+			auto top_end = v2s(top.pos + top.dim);
+			auto end = v2s(box.pos + box.dim);
+			for (int k = 0; k < 2; ++k) {
+				box.pos[k] = std::max(box.pos[k], top.pos[k]);
+				end[k] = std::min(end[k], top_end[k]);
+			}
+			box.dim = v2s(end - box.pos);
+			for (int k = 0; k < 2; ++k) {
+				box.dim[k] = std::max<int16_t>(box.dim[k], 0);
+			}
+			scissor = scissor or clips.back().scissor;
+		}
+
+		if (scissor) {
+			flush();
+		}
+		clips.push_back(Clip{box, scissor});
+		if (scissor) {
+			set_scissor();
+		}
+	}
+
+	void Front::pop_clip() {
+		assert(not clips.empty());
+		bool scissor = clips.back().scissor;
+		if (scissor) {
+			flush();
+		}
+		clips.pop_back();
+		if (scissor) {
+			set_scissor();
+		}
+	}
+
+	void Front::set_scissor() {
+		if (clips.empty() or not clips.back().scissor) {
+			glDisable(GL_SCISSOR_TEST);
+		}
+		else {
+			// box is in context coords, the viewport spans the window
+			auto & b = clips.back().box;
+			auto to_win = [&](int k, int32_t x) {
+				return GLint((x * win_dim[k] + ctx_dim[k] / 2) / ctx_dim[k]);
+			};
+			GLint x0 = to_win(0, b.pos[0]);
+			GLint x1 = to_win(0, int32_t(b.pos[0]) + b.dim[0]);
+			GLint y0 = to_win(1, b.pos[1]);
+			GLint y1 = to_win(1, int32_t(b.pos[1]) + b.dim[1]);
+
+			// GL origin is bottom left
+			glEnable(GL_SCISSOR_TEST);
+			glScissor(x0, win_dim[1] - y1, x1 - x0, y1 - y0);
+		}
+		CHECK_GL();
+	}
+
+	void Front::push_quad(Texture const& t, GLuint pal, v2s pos, v2s end, v2s uv0, v2s uv1, Color c) {
+		if (place_quad(pos, end, uv0, uv1)) {
+			queue_quad(make_quad(t, pal, pos, end, uv0, uv1, c));
+		}
+	}
+
+	bool Front::place_quad(v2s & pos, v2s & end, v2s & uv0, v2s & uv1) {
+		// world to context; offscreen quads never reach the batch
+		if (not view_quad(view, ctx_dim, clip_view, pos, end, uv0, uv1)) {
+			stats.culled += 1;
+			return false;
+		}
+
+		if (not clips.empty()) {
+			auto & clip = clips.back();
+			v2s p = pos, e = end, a = uv0, b = uv1;
+			if (not clip_quad(clip.box, p, e, a, b)) {
+				stats.clipped += 1;
+				return false;
+			}
+			// scissored clips keep the quad whole, GL cuts it
+			if (not clip.scissor) {
+				pos = p; end = e; uv0 = a; uv1 = b;
+			}
+		}
+		return true;
+	}
+
+	void Front::queue_quad(Quad q) {
+		q.sampler = fit_sampler(cur_sampler, q);
+
+		// key: layer | [palette | texture] | submission order
+		uint64_t seq = quads.size();
+		uint64_t key = (uint64_t(cur_layer) << 56) | seq;
+		if (layer_sorted[cur_layer]) {
+			key |= (uint64_t(q.pal & 0xff) << 48) | (uint64_t(q.tex & 0xffff) << 32);
+		}
+		keys.push_back(key);
+		quads.push_back(q);
+
+		for (GLuint id: {q.tex, q.pal}) {
+			if (id >= sampled.size()) {
+				sampled.resize(id + 1, 0);
+			}
+			sampled[id] = sampled_gen;
+		}
+
+		stats.quads += 1;
+	}
+
+	int16_t to_offset(float x) {
+		float v = std::round(x * OffsetScale);
+		assert(v >= -32768.0f and v <= 32767.0f);
+		return int16_t(std::min(std::max(v, -32768.0f), 32767.0f));
+	}
+
+	bool Front::cull_bounds(v2s & pos, float r) {
+		// true if box of radius r around pos (world coords) is not visible;
+		// otherwise pos is moved to context coords
+		int32_t x = int32_t(pos[0]) - view[0];
+		int32_t y = int32_t(pos[1]) - view[1];
+		if (x + r <= 0 or y + r <= 0 or x - r >= ctx_dim[0] or y - r >= ctx_dim[1]) {
+			stats.culled += 1;
+			return true;
+		}
+		// r is bounded by the offset range, so visible positions fit int16
+		pos = v2s(int16_t(x), int16_t(y));
+		if (not clips.empty()) {
+			auto & b = clips.back().box;
+			if (pos[0] + r <= b.pos[0] or pos[1] + r <= b.pos[1] or
+				pos[0] - r >= b.pos[0] + b.dim[0] or pos[1] - r >= b.pos[1] + b.dim[1])
+			{
+				stats.clipped += 1;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Front::push_shape(v2s pos, float x0, float y0, float x1, float y1, float radius, float line, float rot, Color c) {
+		// pos: world anchor; x0..x1, y0..y1: shape box around it, rotated by rot
+
+		float half = 0.5f * std::min(x1 - x0, y1 - y0);
+		auto r16 = uint16_t(std::lround(2.0f * std::max(0.0f, std::min(radius, half))));
+		auto w16 = uint16_t(std::lround(2.0f * std::max(0.0f, line)));
+
+		if (rot == 0.0f) {
+			// axis aligned: whole pixel quad around the box, placed and
+			// clipped like any quad; local coords are linear in position
+			float cx = pos[0] + 0.5f * (x0 + x1);
+			float cy = pos[1] + 0.5f * (y0 + y1);
+			auto p0 = v2s(int16_t(std::floor(pos[0] + x0 - 1)), int16_t(std::floor(pos[1] + y0 - 1)));
+			auto p1 = v2s(int16_t(std::ceil(pos[0] + x1 + 1)), int16_t(std::ceil(pos[1] + y1 + 1)));
+			auto uv0 = v2s(int16_t(std::lround(2.0f * (p0[0] - cx))), int16_t(std::lround(2.0f * (p0[1] - cy))));
+			auto uv1 = v2s(int16_t(std::lround(2.0f * (p1[0] - cx))), int16_t(std::lround(2.0f * (p1[1] - cy))));
+			if (not place_quad(p0, p1, uv0, uv1)) {
+				return;
+			}
+
+			auto q = make_quad(white1x1, 0, p0, p1, uv0, uv1, c);
+			q.shape = true;
+			q.off0 = q.off1 = v2s(to_offset(0.5f * (x1 - x0)), to_offset(0.5f * (y1 - y0)));
+			q.layer = r16;
+			q.line = w16;
+			queue_quad(q);
+			return;
+		}
+
+		// 1 pixel margin for the anti-aliased edge
+		x0 -= 1; y0 -= 1;
+		x1 += 1; y1 += 1;
+
+		float r = std::max(std::fabs(x0), std::fabs(x1)) + std::max(std::fabs(y0), std::fabs(y1));
+		if (cull_bounds(pos, r)) {
+			return;
+		}
+
+		// local coords centred on box, half pixels
+		auto hx = int16_t(std::lround(x1 - x0));
+		auto hy = int16_t(std::lround(y1 - y0));
+		auto uv0 = v2s(int16_t(-hx), int16_t(-hy));
+		auto uv1 = v2s(hx, hy);
+
+		auto q = make_quad(white1x1, 0, pos, pos, uv0, uv1, c);
+		q.off0 = v2s(to_offset(x0), to_offset(y0));
+		q.off1 = v2s(to_offset(x1), to_offset(y1));
+		q.shape = true;
+		q.layer = r16;
+		q.line = w16;
+
+		float turns = rot / (2.0f * float(M_PI));
+		q.rot = uint16_t(int64_t(std::floor(turns * 65536.0f)) & 0xffff);
+
+		queue_quad(q);
+	}
+
+	void Front::render_rect(b2s box, Color c, float radius, float line) {
+		push_shape(box.pos, 0, 0, box.dim[0], box.dim[1], radius, line, 0, c);
+	}
+
+	void Front::render_circle(v2s center, float r, Color c, float line) {
+		push_shape(center, -r, -r, r, r, r, line, 0, c);
+	}
+
+	void Front::render_line(v2s a, v2s b, float width, Color c) {
+		float dx = b[0] - a[0];
+		float dy = b[1] - a[1];
+		float len = std::sqrt(dx*dx + dy*dy);
+		float h = 0.5f * width;
+		push_shape(a, -h, -h, len + h, h, h, 0, std::atan2(dy, dx), c);
+	}
+
+	void Front::render_sprite(Texture const& t, Sprite const& s) {
+		auto & src = s.src;
+
+		// corners relative to pos, scaled
+		float x0 = -s.origin[0] * s.scale[0];
+		float y0 = -s.origin[1] * s.scale[1];
+		float x1 = (src.dim[0] - s.origin[0]) * s.scale[0];
+		float y1 = (src.dim[1] - s.origin[1]) * s.scale[1];
+
+		// unrotated: plain quad on whole pixels, cpu clipped
+		if (s.rot == 0.0f) {
+			auto pos = v2s(int16_t(s.pos[0] + std::lround(x0)), int16_t(s.pos[1] + std::lround(y0)));
+			auto end = v2s(int16_t(s.pos[0] + std::lround(x1)), int16_t(s.pos[1] + std::lround(y1)));
+			auto uv0 = src.pos;
+			auto uv1 = v2s(src.pos + src.dim);
+			// flips swap texel coords
+			for (int k = 0; k < 2; ++k) {
+				if (pos[k] > end[k]) {
+					std::swap(pos[k], end[k]);
+					std::swap(uv0[k], uv1[k]);
+				}
+			}
+			if (pos[0] < end[0] and pos[1] < end[1]) {
+				push_quad(t, 0, pos, end, uv0, uv1, s.tint);
+			}
+			return;
+		}
+
+		// any rotation stays within r of pos
+		float r = std::max(std::fabs(x0), std::fabs(x1)) + std::max(std::fabs(y0), std::fabs(y1));
+
+		auto pos = s.pos;
+		if (cull_bounds(pos, r)) {
+			return;
+		}
+
+		auto q = make_quad(t, 0, pos, pos, src.pos, v2s(src.pos + src.dim), s.tint);
+		q.off0 = v2s(to_offset(x0), to_offset(y0));
+		q.off1 = v2s(to_offset(x1), to_offset(y1));
+
+		// wraps to one turn
+		float turns = s.rot / (2.0f * float(M_PI));
+		q.rot = uint16_t(int64_t(std::floor(turns * 65536.0f)) & 0xffff);
+
+		queue_quad(q);
+	}
+
+	void nine_slice(std::vector<Slice> & out, b2s trg, b2s src, Borders b, bool tile) {
+		// column/row splits of target and source
+		int16_t tx[4], ty[4], sx[4], sy[4];
+
+		auto split = [](int16_t * t, int16_t * s, int16_t tpos, int16_t tdim, int16_t spos, int16_t sdim, int16_t lo, int16_t hi) {
+			// source keeps the full borders
+			s[0] = spos;
+			s[1] = int16_t(spos + lo);
+			s[2] = int16_t(spos + sdim - hi);
+			s[3] = int16_t(spos + sdim);
+
+			// squeeze borders into small targets
+			if (lo + hi > tdim) {
+				lo = int16_t(int32_t(lo) * tdim / (lo + hi));
+				hi = int16_t(tdim - lo);
+			}
+			t[0] = tpos;
+			t[1] = int16_t(tpos + lo);
+			t[2] = int16_t(tpos + tdim - hi);
+			t[3] = int16_t(tpos + tdim);
 		};
 
-		_render_call_GL(white1x1.id, data, sizeof(data));		
+		split(tx, sx, trg.pos[0], trg.dim[0], src.pos[0], src.dim[0], b.left, b.right);
+		split(ty, sy, trg.pos[1], trg.dim[1], src.pos[1], src.dim[1], b.top, b.bottom);
+
+		for (int j = 0; j < 3; ++j) {
+			for (int i = 0; i < 3; ++i) {
+				auto t = b2s(v2s(tx[i], ty[j]), v2s(int16_t(tx[i+1] - tx[i]), int16_t(ty[j+1] - ty[j])));
+				auto s = b2s(v2s(sx[i], sy[j]), v2s(int16_t(sx[i+1] - sx[i]), int16_t(sy[j+1] - sy[j])));
+				if (t.dim[0] <= 0 or t.dim[1] <= 0 or s.dim[0] <= 0 or s.dim[1] <= 0) {
+					continue;
+				}
+
+				// corners are never tiled (nor scaled, unless squeezed)
+				bool corner = (i != 1 and j != 1);
+				if (not tile or corner) {
+					out.push_back(Slice{t, s});
+					continue;
+				}
+
+				// tile along stretched axes (x for i == 1, y for j == 1)
+				int16_t step_x = (i == 1) ? s.dim[0] : t.dim[0];
+				int16_t step_y = (j == 1) ? s.dim[1] : t.dim[1];
+				for (int32_t y = 0; y < t.dim[1]; y += step_y) {
+					for (int32_t x = 0; x < t.dim[0]; x += step_x) {
+						auto w = int16_t(std::min<int32_t>(step_x, t.dim[0] - x));
+						auto h = int16_t(std::min<int32_t>(step_y, t.dim[1] - y));
+						auto pt = b2s(v2s(int16_t(t.pos[0] + x), int16_t(t.pos[1] + y)), v2s(w, h));
+						// stretched axis keeps the full source
+						auto ps = b2s(s.pos, v2s(
+							(i == 1) ? w : s.dim[0],
+							(j == 1) ? h : s.dim[1]
+						));
+						out.push_back(Slice{pt, ps});
+					}
+				}
+			}
+		}
+	}
+
+	void Front::render_nine_slice(Texture const& t, b2s trg, b2s src, Borders b, bool tile, Color fg) {
+		slices.clear();
+		nine_slice(slices, trg, src, b, tile);
+		for (auto & p: slices) {
+			push_quad(t, 0, p.trg.pos, v2s(p.trg.pos + p.trg.dim), p.src.pos, v2s(p.src.pos + p.src.dim), fg);
+		}
 	}
 
-	void Front::render_subtexture(Texture const& t, v2s trg, b2s src) {
+	void Front::render_texture(Texture const& t, b2s trg, b2s src, Color fg) {
+		// texel coords interpolate across target, clips cut it like any quad
+		push_quad(t, 0, trg.pos, v2s(trg.pos + trg.dim), src.pos, v2s(src.pos + src.dim), fg);
+	}
 
-		auto t_pos = v2f(trg);
-		auto t_end = v2f(trg + src.dim);
+	void emit_quad(std::vector<Vertex> & verts, Quad const& q, GLubyte slot) {
+		// quad corners x,y + u,v + tint; triangles from static indices
+		auto & pos = q.pos;
+		auto & end = q.end;
+		GLushort u0 = q.uv0[0], v0 = q.uv0[1], u1 = q.uv1[0], v1 = q.uv1[1];
+		auto c = q.tint;
+		auto l = q.layer;
+		Vertex vs[] = {
+			{pos[0], pos[1],  u0, v0,  c, l, slot, 0},
+			{pos[0], end[1],  u0, v1,  c, l, slot, 0},
+			{end[0], end[1],  u1, v1,  c, l, slot, 0},
+			{end[0], pos[1],  u1, v0,  c, l, slot, 0},
+		};
+		verts.insert(verts.end(), std::begin(vs), std::end(vs));
+	}
 
-		auto rs_pos = vdiv(v2f(src.pos), v2f(t.dim));
-		auto rs_end = vdiv(v2f(src.pos + src.dim), v2f(t.dim));
-		
-		// quad as triangle fan x,y + u,v
-		GLfloat data[] = {
-			t_pos[0], t_pos[1],  rs_pos[0], rs_pos[1],
-			t_pos[0], t_end[1],  rs_pos[0], rs_end[1], 
-			t_end[0], t_end[1],  rs_end[0], rs_end[1],
-			t_end[0], t_pos[1],  rs_end[0], rs_pos[1],
+	void emit_ext_quad(std::vector<ExtVertex> & verts, Quad const& q, GLubyte slot) {
+		GLushort u0 = q.uv0[0], v0 = q.uv0[1], u1 = q.uv1[0], v1 = q.uv1[1];
+		if (q.shape) {
+			// signed local coords to biased unsigned
+			u0 = uint16_t(int32_t(q.uv0[0]) + ShapeBias);
+			v0 = uint16_t(int32_t(q.uv0[1]) + ShapeBias);
+			u1 = uint16_t(int32_t(q.uv1[0]) + ShapeBias);
+			v1 = uint16_t(int32_t(q.uv1[1]) + ShapeBias);
+		}
+		auto & pos = q.pos;
+		auto & end = q.end;
+		auto & o0 = q.off0;
+		auto & o1 = q.off1;
+		auto c = q.tint;
+		auto l = q.layer;
+		auto r = q.rot;
+		auto w = q.line;
+		ExtVertex vs[] = {
+			{{pos[0], pos[1],  u0, v0,  c, l, slot, 0},  o0[0], o0[1], r, w},
+			{{pos[0], end[1],  u0, v1,  c, l, slot, 0},  o0[0], o1[1], r, w},
+			{{end[0], end[1],  u1, v1,  c, l, slot, 0},  o1[0], o1[1], r, w},
+			{{end[0], pos[1],  u1, v0,  c, l, slot, 0},  o1[0], o0[1], r, w},
 		};
+		verts.insert(verts.end(), std::begin(vs), std::end(vs));
+	}
+
+	// rotated sprites (pos == end) and shapes need the ExtVertex stream
+	bool is_ext(Quad const& q) {
+		return q.shape or q.pos == q.end;
+	}
 
-		_render_call_GL(t.id, data, sizeof(data));
+	// 0: rgba slots, 1: palette, 2: array page
+	int get_mode(Quad const& q) {
+		return q.pal ? 1 : (q.target == GL_TEXTURE_2D_ARRAY) ? 2 : 0;
 	}
 
-	void Front::_render_call_GL(GLenum tex_id, GLfloat * data, size_t size) {
-		// set texture
+	void Front::build_runs(std::vector<Run> & runs, std::vector<Vertex> & verts, std::vector<ExtVertex> & ext_verts, Quad const* qs, uint64_t const* order, size_t n, size_t base) {
+		auto quad_at = [&](size_t i) -> Quad const& {
+			return order ? qs[order[i] & KeySeqMask] : qs[i];
+		};
+
+		// quads of this chunk in each stream
+		size_t v0 = verts.size();
+		size_t e0 = ext_verts.size();
+		auto count = [&](bool ext) {
+			return ext ? (ext_verts.size() - e0) / 4 : (verts.size() - v0) / 4;
+		};
+
+		// split into runs; rgba runs take up to slot_count textures
+		size_t r = 0;
+		while (r < n) {
+			auto & q0 = quad_at(r);
+
+			Run run;
+			run.base = base;
+			run.ext = is_ext(q0);
+			run.begin = count(run.ext);
+			run.nslots = 0;
+			run.mode = get_mode(q0);
+			run.tex = q0.tex;
+			run.pal = q0.pal;
+			run.dim = q0.tex_dim;
+			run.samp = q0.sampler;
+
+			size_t e = r;
+			while (e < n) {
+				auto & q = quad_at(e);
+				if (get_mode(q) != run.mode or is_ext(q) != run.ext) {
+					break;
+				}
+
+				GLubyte slot = 0;
+				if (q.shape) {
+					// no texture; rotated shapes have pos == end
+					slot = (q.pos == q.end) ? ShapeSlot : ShapeAxisSlot;
+				}
+				else if (run.mode == 0) {
+					while (slot < run.nslots and (run.slots[slot] != q.tex or run.samps[slot] != q.sampler)) {
+						++slot;
+					}
+					if (slot == run.nslots) {
+						if (run.nslots == slot_count) {
+							break;
+						}
+						run.slots[slot] = q.tex;
+						run.dims[slot] = q.tex_dim;
+						run.samps[slot] = q.sampler;
+						run.nslots += 1;
+					}
+				}
+				else if (q.tex != run.tex or q.pal != run.pal or q.sampler != run.samp) {
+					break;
+				}
+
+				// image switch that did not cost a draw
+				if (e > r) {
+					auto & p = quad_at(e - 1);
+					if (p.tex != q.tex or p.layer != q.layer) {
+						stats.merged += 1;
+					}
+				}
+
+				if (run.ext) {
+					emit_ext_quad(ext_verts, q, slot);
+				}
+				else {
+					emit_quad(verts, q, slot);
+				}
+				++e;
+			}
+
+			run.end = count(run.ext);
+			runs.push_back(run);
+			r = e;
+		}
+	}
+
+	void Front::draw_runs(Run const* rs, size_t n) {
+		auto bind = [&](int unit, GLenum target, GLuint tex) {
+			if (bound[unit] != tex) {
+				glActiveTexture(GL_TEXTURE0 + unit);
+				glBindTexture(target, tex);
+				bound[unit] = tex;
+			}
+		};
+
+		auto bind_sampler = [&](int unit, SamplerOpts s) {
+			if (bound_samp[unit] != s) {
+				glBindSampler(unit, samplers[s]);
+				bound_samp[unit] = s;
+			}
+		};
+
+		// caller has the Vertex VAO bound
+		bool ext = false;
+		for (size_t i = 0; i < n; ++i) {
+			auto & run = rs[i];
+
+			if (run.ext != ext) {
+				glBindVertexArray(vao[run.ext]);
+				ext = run.ext;
+			}
+
+			GLfloat dims[2 * max_slots];
+			if (run.mode == 0) {
+				for (int s = 0; s < run.nslots; ++s) {
+					bind(s, GL_TEXTURE_2D, run.slots[s]);
+					bind_sampler(s, run.samps[s]);
+					dims[2*s + 0] = run.dims[s][0];
+					dims[2*s + 1] = run.dims[s][1];
+				}
+				glUniform2fv(u_tex_dim, run.nslots, dims);
+			}
+			else {
+				if (run.mode == 1) {
+					bind(0, GL_TEXTURE_2D, run.tex);
+					bind_sampler(0, SampNearest);
+					bind(unit_palette, GL_TEXTURE_2D, run.pal);
+					bind_sampler(unit_palette, SampNearest);
+				}
+				else {
+					bind(unit_array, GL_TEXTURE_2D_ARRAY, run.tex);
+					bind_sampler(unit_array, run.samp);
+				}
+				glUniform2f(u_tex_dim, run.dim[0], run.dim[1]);
+			}
+
+			if (run.mode != bound_mode) {
+				glUniform1i(u_mode, run.mode);
+				bound_mode = run.mode;
+			}
+			CHECK_GL();
+
+			glDrawElements(GL_TRIANGLES, GLsizei(6 * (run.end - run.begin)), GL_UNSIGNED_SHORT,
+				(GLvoid*)(6 * run.begin * sizeof(GLushort))
+			);
+			CHECK_GL();
+
+			stats.draws += 1;
+		}
+
+		if (ext) {
+			glBindVertexArray(vao[0]);
+		}
+	}
+
+	void Front::reset_binds() {
+		std::fill(std::begin(bound), std::end(bound), 0);
+
+		// leave texture parameters in charge for other programs
+		for (int u = 0; u < slot_count + 2; ++u) {
+			if (bound_samp[u] >= 0) {
+				glBindSampler(u, 0);
+				bound_samp[u] = -1;
+			}
+		}
+		if (bound_mode != 0) {
+			glUniform1i(u_mode, 0);
+			bound_mode = 0;
+		}
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex_id);
 		CHECK_GL();
+	}
 
-		// update array
-		glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-		glBufferData(GL_ARRAY_BUFFER, size, data, GL_DYNAMIC_DRAW);
-		CHECK_GL();
+	void Front::flush() {
+		if (quads.empty()) {
+			return;
+		}
+
+		radix_sort(keys, keys_tmp);
 
 		glBindVertexArray(vao[0]);
 		CHECK_GL();
-		
-		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-		CHECK_GL();
-	}
 
+		size_t n = keys.size();
+		size_t i = 0;
+		while (i < n) {
+			// chunk addressable by static index buffer
+			size_t m = n - i;
+			if (m > max_batch_quads) {
+				m = max_batch_quads;
+			}
+
+			runs.clear();
+			verts.clear();
+			ext_verts.clear();
+			build_runs(runs, verts, ext_verts, quads.data(), keys.data() + i, m, 0);
 
+			glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+			glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(Vertex), verts.data(), GL_DYNAMIC_DRAW);
+			if (not ext_verts.empty()) {
+				glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+				glBufferData(GL_ARRAY_BUFFER, ext_verts.size() * sizeof(ExtVertex), ext_verts.data(), GL_DYNAMIC_DRAW);
+			}
+			CHECK_GL();
 
-	
+			draw_runs(runs.data(), runs.size());
 
-	void Front::render_texture(Texture const& t, v2s trg, b2s src)
-	{
-		set_blend_norm();
-		render_subtexture(t,trg,src);	
+			i += m;
+		}
+
+		reset_binds();
+
+		quads.clear();
+		keys.clear();
+		sampled_gen += 1;
 	}
 
-	void Front::render_texture(Texture const& t, v2s pos_) {
-		set_blend_norm();
+	void Front::set_vertex_format(size_t base, bool ext) {
+		// base: byte offset of first vertex in bound array buffer
+		GLsizei stride = ext ? sizeof(ExtVertex) : sizeof(Vertex);
+		{
+			auto loc = myGetAttribLocation(prog[0], "a_xy");
+			glEnableVertexAttribArray(loc);
+			glVertexAttribPointer(loc, 2, GL_SHORT, GL_FALSE, stride, (GLvoid*)(base + offsetof(Vertex, x)));
+			CHECK_GL();
+		}
 
+		{
+			auto loc = myGetAttribLocation(prog[0], "a_uv");
+			glEnableVertexAttribArray(loc);
+			glVertexAttribPointer(loc, 2, GL_UNSIGNED_SHORT, GL_FALSE, stride, (GLvoid*)(base + offsetof(Vertex, u)));
+			CHECK_GL();
+		}
 
-		v2f pos = v2f(pos_);
-		v2f end = pos + t.dim;
-		
-		// quad as triangle fan x,y + u,v
-		GLfloat data[] = {
-			pos[0], pos[1],  0.0f, 0.0f,
-			pos[0], end[1],  0.0f, 1.0f, 
-			end[0], end[1],  1.0f, 1.0f,
-			end[0], pos[1],  1.0f, 0.0f,
-		};
+		{
+			auto loc = myGetAttribLocation(prog[0], "a_tint");
+			glEnableVertexAttribArray(loc);
+			glVertexAttribPointer(loc, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (GLvoid*)(base + offsetof(Vertex, tint)));
+			CHECK_GL();
+		}
 
-		// set texture
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, t.id);
+		{
+			auto loc = myGetAttribLocation(prog[0], "a_layer");
+			glEnableVertexAttribArray(loc);
+			glVertexAttribPointer(loc, 1, GL_UNSIGNED_SHORT, GL_FALSE, stride, (GLvoid*)(base + offsetof(Vertex, layer)));
+			CHECK_GL();
+		}
+
+		{
+			auto loc = myGetAttribLocation(prog[0], "a_slot");
+			glEnableVertexAttribArray(loc);
+			glVertexAttribPointer(loc, 1, GL_UNSIGNED_BYTE, GL_FALSE, stride, (GLvoid*)(base + offsetof(Vertex, slot)));
+			CHECK_GL();
+		}
+
+		// without the arrays vert0 reads the constant zeros set in create_GL
+		auto off = myGetAttribLocation(prog[0], "a_off");
+		auto rot = myGetAttribLocation(prog[0], "a_rot");
+		auto line = myGetAttribLocation(prog[0], "a_line");
+		if (not ext) {
+			glDisableVertexAttribArray(off);
+			glDisableVertexAttribArray(rot);
+			glDisableVertexAttribArray(line);
+			CHECK_GL();
+			return;
+		}
+
+		glEnableVertexAttribArray(off);
+		glVertexAttribPointer(off, 2, GL_SHORT, GL_FALSE, stride, (GLvoid*)(base + offsetof(ExtVertex, ox)));
+		glEnableVertexAttribArray(rot);
+		glVertexAttribPointer(rot, 1, GL_UNSIGNED_SHORT, GL_FALSE, stride, (GLvoid*)(base + offsetof(ExtVertex, rot)));
+		glEnableVertexAttribArray(line);
+		glVertexAttribPointer(line, 1, GL_UNSIGNED_SHORT, GL_FALSE, stride, (GLvoid*)(base + offsetof(ExtVertex, line)));
 		CHECK_GL();
+	}
 
-		// update array
-		glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_DYNAMIC_DRAW);
+	void Front::update_layer(StaticLayer & layer) {
+		if (layer.vao == 0) {
+			glGenVertexArrays(1, &layer.vao);
+			glGenBuffers(1, &layer.vbo);
+			CHECK_GL();
+		}
+
+		layer.runs.clear();
+		verts.clear();
+		ext_verts.clear();
+		for (size_t i = 0; i < layer.quads.size(); i += max_batch_quads) {
+			size_t m = layer.quads.size() - i;
+			if (m > max_batch_quads) {
+				m = max_batch_quads;
+			}
+			build_runs(layer.runs, verts, ext_verts, layer.quads.data() + i, nullptr, m, i);
+		}
+		// layers record axis aligned quads only
+		assert(ext_verts.empty());
+
+		glBindVertexArray(layer.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, layer.vbo);
+		glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(Vertex), verts.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo[0]);
+		set_vertex_format(0);
 		CHECK_GL();
 
-		glBindVertexArray(vao[0]);
+		layer.dirty = false;
+	}
+
+	void Front::draw_layer(StaticLayer & layer, v2s offset) {
+		// keep order with quads submitted before
+		flush();
+
+		if (layer.dirty) {
+			update_layer(layer);
+		}
+		if (layer.runs.empty()) {
+			return;
+		}
+
+		glBindVertexArray(layer.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, layer.vbo);
+		glUniform2f(u_offset, offset[0], offset[1]);
 		CHECK_GL();
-		
-		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-		CHECK_GL();		
-		
-		
+
+		// chunks past the first are reached by moving attribute base
+		size_t base = 0;
+		size_t r = 0;
+		while (r < layer.runs.size()) {
+			size_t e = r;
+			while (e < layer.runs.size() and layer.runs[e].base == layer.runs[r].base) {
+				++e;
+			}
+			if (layer.runs[r].base != base) {
+				base = layer.runs[r].base;
+				set_vertex_format(4 * base * sizeof(Vertex));
+			}
+			draw_runs(&layer.runs[r], e - r);
+			r = e;
+		}
+		if (base != 0) {
+			set_vertex_format(0);
+		}
+
+		glUniform2f(u_offset, 0, 0);
+		reset_binds();
+	}
+
+	void Front::flip() {
+		flush();
+		SDL_GL_SwapWindow(win);
+
+		last_stats = stats;
+		stats = RenderStats();
+	}
+
+	void Front::render_texture(Texture const& t, v2s trg, b2s src)
+	{
+		render_subtexture(t, 0, trg, src, Color(255,255,255,255));
+	}
+
+	void Front::render_texture(Texture const& t, v2s pos) {
+		auto end = v2s(pos + t.dim);
+
+		push_quad(t, 0, pos, end, v2s(0,0), t.dim, Color(255,255,255,255));
 	}
 
 	void Front::destroy_GL() {
-		glDeleteBuffers(1, vbo);
-		glDeleteVertexArrays(1, vao);
+		remove_texture_user(this);
+		arrays.clear();
+		glDeleteBuffers(2, vbo);
+		glDeleteBuffers(1, ebo);
+		glDeleteVertexArrays(2, vao);
+		glDeleteSamplers(SamplerCount, samplers);
 		glDeleteProgram(prog[0]);
+		glDeleteProgram(prog[1]);
+		glDeleteProgram(prog[2]);
+		glDeleteProgram(prog[3]);
 		CHECK_GL();
 	}
 
@@ -292,6 +1522,11 @@ namespace frontend {
 		init_glew();
 		CHECK_GL();
 
+		// queued quads hold raw texture ids until flush
+		add_texture_user(this, [](void const* user, GLuint id) {
+			return ((Front const*)user)->uses_texture(id);
+		});
+
 		// render texture program
 		prog[0] = glCreateProgram();
 		myAttachShader(prog[0], GL_VERTEX_SHADER, shader::vert0);
@@ -303,30 +1538,46 @@ namespace frontend {
 		CHECK_GL();
 
 		
-		glGenVertexArrays(1, vao);
+		glGenVertexArrays(2, vao);
 		CHECK_GL();
 		
-		glGenBuffers(1, vbo);
+		glGenBuffers(2, vbo);
+		glGenBuffers(1, ebo);
+		CHECK_GL();
+
+		// vertex_array[1] => Vertex + corner offset, rotation, line
+		glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+		glBindVertexArray(vao[1]);
+		set_vertex_format(0, true);
 		CHECK_GL();
 
-		// vertex_array[0] => x y u v
+		// vertex_array[0] => x y u v tint layer slot
 		glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
 		CHECK_GL();
 		
 		glBindVertexArray(vao[0]);
 		CHECK_GL();
 
+		set_vertex_format(0);
+
+		// plain quads: no offset, rotation or outline
+		glVertexAttrib4f(myGetAttribLocation(prog[0], "a_off"), 0, 0, 0, 1);
+		glVertexAttrib4f(myGetAttribLocation(prog[0], "a_rot"), 0, 0, 0, 1);
+		glVertexAttrib4f(myGetAttribLocation(prog[0], "a_line"), 0, 0, 0, 1);
+		CHECK_GL();
+
+		// quad i => 4i+0,1,2, 4i+2,3,0; bound to both vaos for good
 		{
-			auto loc = myGetAttribLocation(prog[0], "a_xy");		
-			glEnableVertexAttribArray(loc);
-			glVertexAttribPointer(loc, 2, GL_FLOAT, GL_FALSE, 4*sizeof(GLfloat), 0);
-			CHECK_GL();
-		}
-		
-		{
-			auto loc = myGetAttribLocation(prog[0], "a_uv");
-			glEnableVertexAttribArray(loc);
-			glVertexAttribPointer(loc, 2, GL_FLOAT, GL_FALSE, 4*sizeof(GLfloat), (GLvoid*)(2*sizeof(GLfloat)));
+			std::vector<GLushort> idx(6 * max_batch_quads);
+			for (size_t i = 0; i < max_batch_quads; ++i) {
+				auto b = GLushort(4 * i);
+				GLushort q[] = {b, GLushort(b+1), GLushort(b+2), GLushort(b+2), GLushort(b+3), b};
+				std::copy(std::begin(q), std::end(q), &idx[6*i]);
+			}
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo[0]);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(GLushort), idx.data(), GL_STATIC_DRAW);
+			glBindVertexArray(vao[1]);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo[0]);
 			CHECK_GL();
 		}
 
@@ -338,6 +1589,14 @@ namespace frontend {
 		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 		CHECK_GL();
 
+		// single blend mode; colour comes from per-vertex tint
+		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glBlendEquation(GL_FUNC_ADD);
+		glEnable(GL_BLEND);
+		CHECK_GL();
+
+		verts.reserve(4 * max_batch_quads);
+
 		this->proj = make_projection_matrix(ctx_dim[0], ctx_dim[1]);
 
 		// activate prog[0] (render texture simple)
@@ -350,7 +1609,108 @@ namespace frontend {
 		);
 		CHECK_GL();
 
-		glUniform1i(myGetUniformLocation(prog[0], "s_texture"), 0);
+		// units: 0..slot_count-1 rgba slots, then palette, then array
+		{
+			GLint units = 0;
+			glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+			slot_count = int(std::min<GLint>(GLint(max_slots), units - 2));
+			if (slot_count < 1) {
+				ext::fail("ERROR: GL: too few texture units: %||\n", units);
+			}
+			unit_palette = slot_count;
+			unit_array = slot_count + 1;
+
+			// unused array entries share the last slot unit
+			GLint ids[max_slots];
+			for (int s = 0; s < max_slots; ++s) {
+				ids[s] = std::min(s, slot_count - 1);
+			}
+			glUniform1iv(myGetUniformLocation(prog[0], "s_texture"), max_slots, ids);
+			glUniform1i(myGetUniformLocation(prog[0], "s_palette"), unit_palette);
+			glUniform1i(myGetUniformLocation(prog[0], "s_array"), unit_array);
+			CHECK_GL();
+		}
+
+		u_tex_dim = myGetUniformLocation(prog[0], "u_tex_dim");
+		u_mode = myGetUniformLocation(prog[0], "u_mode");
+		u_offset = myGetUniformLocation(prog[0], "u_offset");
+		glUniform1i(u_mode, 0);
+		CHECK_GL();
+
+		has_bc =
+			myHasExtension("GL_EXT_texture_compression_s3tc") or
+			myHasExtension("GL_WEBGL_compressed_texture_s3tc");
+
+		// gpu sprite programs, see GpuSprites
+		#ifndef __EMSCRIPTEN__
+		{
+			GLint major = 0, minor = 0;
+			glGetIntegerv(GL_MAJOR_VERSION, &major);
+			glGetIntegerv(GL_MINOR_VERSION, &minor);
+			has_compute = major > 4 or (major == 4 and minor >= 3);
+			has_buffer_storage = major > 4 or (major == 4 and minor >= 4) or
+				myHasExtension("GL_ARB_buffer_storage");
+			has_format_query = major > 4 or (major == 4 and minor >= 3) or
+				myHasExtension("GL_ARB_internalformat_query2");
+			has_bgra = true;
+		}
+		if (has_format_query) {
+			// driver's preferred upload format for RGBA8
+			GLint fmt = GL_RGBA;
+			glGetInternalformativ(GL_TEXTURE_2D, GL_RGBA8, GL_TEXTURE_IMAGE_FORMAT, 1, &fmt);
+			CHECK_GL();
+			prefer_bgra = (GLenum(fmt) == FormatBGRA);
+			if (verbose) {
+				print("INFO: preferred upload format: %||\n", prefer_bgra ? "bgra (bake -b)" : "rgba");
+			}
+		}
+		if (has_compute) {
+			prog[1] = glCreateProgram();
+			myAttachShader(prog[1], GL_COMPUTE_SHADER, shader::cull1);
+			myLinkProgram(prog[1]);
+
+			prog[2] = glCreateProgram();
+			myAttachShader(prog[2], GL_VERTEX_SHADER, shader::vert2);
+			myAttachShader(prog[2], GL_FRAGMENT_SHADER, shader::frag2);
+			myLinkProgram(prog[2]);
+
+			glUseProgram(prog[2]);
+			glUniformMatrix4fv(myGetUniformLocation(prog[2], "m_proj"), 1, GL_FALSE, glm::value_ptr(this->proj));
+			glUniform1i(myGetUniformLocation(prog[2], "s_texture"), 0);
+			glUseProgram(prog[0]);
+			CHECK_GL();
+
+			has_draw_params = myHasExtension("GL_ARB_shader_draw_parameters");
+		}
+		if (has_draw_params) {
+			prog[3] = glCreateProgram();
+			myAttachShader(prog[3], GL_VERTEX_SHADER, shader::vert3);
+			myAttachShader(prog[3], GL_FRAGMENT_SHADER, shader::frag2);
+			myLinkProgram(prog[3]);
+
+			glUseProgram(prog[3]);
+			glUniformMatrix4fv(myGetUniformLocation(prog[3], "m_proj"), 1, GL_FALSE, glm::value_ptr(this->proj));
+			glUniform1i(myGetUniformLocation(prog[3], "s_texture"), 0);
+			glUseProgram(prog[0]);
+			CHECK_GL();
+		}
+		#endif
+
+		// all combinations of SamplerOpts
+		glGenSamplers(SamplerCount, samplers);
+		for (int s = 0; s < SamplerCount; ++s) {
+			GLenum mag = (s & SampLinear) ? GL_LINEAR : GL_NEAREST;
+			GLenum min = mag;
+			if (s & SampMipmap) {
+				min = (s & SampLinear) ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_NEAREST;
+			}
+			GLenum wrap = (s & SampRepeat) ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+			glSamplerParameteri(samplers[s], GL_TEXTURE_MAG_FILTER, mag);
+			glSamplerParameteri(samplers[s], GL_TEXTURE_MIN_FILTER, min);
+			glSamplerParameteri(samplers[s], GL_TEXTURE_WRAP_S, wrap);
+			glSamplerParameteri(samplers[s], GL_TEXTURE_WRAP_T, wrap);
+		}
+		CHECK_GL();
 
 		uint8_t rgba[] = {255,255,255,255};
 		white1x1 = make_texture(rgba, {1,1});
@@ -361,6 +1721,7 @@ namespace frontend {
 	}
 
 	void Front::clear() {
+		flush();
 		glClear(GL_COLOR_BUFFER_BIT);
 		CHECK_GL();
 	}
@@ -1,6 +1,7 @@
 #pragma once
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
+#include <bitset>
 #include "../ext/ext.hpp"
 #include "glm.hpp"
 #include "color.hpp"
@@ -14,21 +15,67 @@ namespace frontend {
 
 	using Image = darray2::darray2<Color, int16_t>;
 
+	// texture load options (bit flags)
+	using TexOpts = uint32_t;
+	TexOpts const TexNone = 0;
+	TexOpts const TexMask = 1 << 0;  // single channel if image is mask-like
+	TexOpts const TexArray = 1 << 1;  // layer of shared array page
+	TexOpts const TexMipmap = 1 << 2;  // mip chain, for textures drawn downscaled
+
+	// sampling of following quads (bit flags), see Front::set_sampler
+	using SamplerOpts = uint8_t;
+	SamplerOpts const SampNearest = 0;
+	SamplerOpts const SampLinear = 1 << 0;
+	SamplerOpts const SampRepeat = 1 << 1;   // else clamp to edge
+	SamplerOpts const SampMipmap = 1 << 2;   // ignored for textures without mips
+	int const SamplerCount = 8;
+
+
+	// pixel upload format of desktop GL (GL_BGRA), not in GLES headers
+	GLenum const FormatBGRA = 0x80E1;
+
+	// bytes of texture storage in given format
+	size_t get_texture_bytes(GLenum format, v2s dim);
+
+	// pending GL work that holds texture ids (queued quads, streamed
+	// uploads) registers here; Texture::destroy asserts none uses it
+	using TextureUseFn = bool (*)(void const* user, GLuint id);
+	void add_texture_user(void const* user, TextureUseFn uses);
+	void remove_texture_user(void const* user);
+	bool is_texture_used(GLuint id);
 
 	struct Texture {
 		GLuint id{0};
 		v2s dim;
 		GLenum format{GL_RGBA};
 
+		// layer of array page (see make_array_texture); not owned
+		GLenum target{GL_TEXTURE_2D};
+		uint16_t layer{0};
+		v2s page{0,0};
+		bool owner{true};
+
+		uint8_t levels{1};  // mip levels
+
 		void create();
 		void destroy();
 
+		size_t get_bytes() const {
+			auto b = get_texture_bytes(format, dim);
+			return levels > 1 ? b + b / 3 : b;
+		}
+
 		Texture() = default;
 		Texture(Texture const& o) = delete;		
 		Texture(Texture && o):
 			id(o.id),
 			dim(o.dim),
-			format(o.format)
+			format(o.format),
+			target(o.target),
+			layer(o.layer),
+			page(o.page),
+			owner(o.owner),
+			levels(o.levels)
 		{			
 			o.id = 0;
 		}		
@@ -36,16 +83,127 @@ namespace frontend {
 			id = o.id;
 			dim = o.dim;
 			format = o.format;
+			target = o.target;
+			layer = o.layer;
+			page = o.page;
+			owner = o.owner;
+			levels = o.levels;
 			o.id = 0;
 		}
 		~Texture() {
-			if (id != 0) {
+			if (id != 0 and owner) {
 				destroy();
 			}
 		}
+
+		// size used to normalize texel coords
+		v2s get_store_dim() const { return target == GL_TEXTURE_2D_ARRAY ? page : dim; }
+	};
+
+	// palette image: colour index per pixel
+	struct IndexedImage {
+		v2s dim{0,0};
+		std::vector<uint8_t> index;
+		std::vector<Color> palette;  // at most 256
+	};
+
+	// index texture (GL_R8, not swizzled) + its default palette (256x1)
+	struct IndexedTexture {
+		Texture index;
+		Texture palette;
+		v2s get_dim() const { return index.dim; }
+	};
+
+	// batch vertex: pixel position, texel coords, tint, array layer,
+	// texture slot (sampler unit)
+	struct Vertex {
+		GLshort x, y;
+		GLushort u, v;
+		Color tint;
+		GLushort layer;  // shapes: corner radius, 1/2 pixel
+		GLubyte slot;    // ShapeSlot or ShapeAxisSlot for shapes
+		GLubyte _pad;
+	};
+
+	// vertex of rotated sprites and shapes, in a stream of its own so
+	// plain quads keep the compact Vertex; corner offset rotated in vert0
+	struct ExtVertex {
+		Vertex v;
+		GLshort ox, oy;  // 1/8 pixel, relative to x,y
+		GLushort rot;    // turns * 65536, clockwise
+		GLushort line;   // shapes: outline width, 1/2 pixel; 0 fills
+	};
+
+	// sub-pixel steps of ExtVertex::ox, oy; offsets reach +-4095 pixels
+	int const OffsetScale = 8;
+
+	// shapes: u,v hold local coords around the centre (1/2 pixel, biased);
+	// rotated shapes (ShapeSlot) have ox,oy corner offsets around x,y,
+	// axis aligned ones (ShapeAxisSlot) whole pixel x,y, possibly cut by
+	// a clip, and the shape half size in ox,oy (1/8 pixel)
+	GLubyte const ShapeSlot = 255;
+	GLubyte const ShapeAxisSlot = 254;
+	int32_t const ShapeBias = 32768;
+
+	// GL_TEXTURE_2D_ARRAY page; images of up to dim become layers
+	struct TextureArray {
+		Texture tex;
+		uint16_t used{0};
+		uint16_t capacity{0};
+	};
+
+	// submitted quad, drawn at flush in key order
+	struct Quad {
+		GLuint tex;
+		GLuint pal;  // palette texture or 0
+		GLenum target;
+		uint16_t layer;
+		v2s tex_dim;
+		v2s pos, end;
+		v2s uv0, uv1;  // texel coords
+		Color tint;
+		v2s off0, off1;  // corner offsets of rotated quads (pos == end)
+		uint16_t rot;
+		bool shape;      // sdf shape, layer and line hold its params
+		uint16_t line;
+		bool mips;       // texture has mip levels
+		bool padded;     // array layer smaller than its page
+		SamplerOpts sampler;
+	};
+
+	// nine-slice frame borders in src pixels
+	struct Borders {
+		int16_t left{0}, top{0}, right{0}, bottom{0};
+	};
+
+	// piece of a nine-slice frame: src drawn over trg
+	struct Slice {
+		b2s trg;
+		b2s src;
+	};
+
+	// sprite submission; rotated corners are expanded in vert0
+	struct Sprite {
+		v2s pos;              // where origin lands
+		b2s src;              // texel rect
+		v2s origin{0,0};      // pivot, in src pixels
+		v2f scale{1.0f,1.0f}; // negative flips
+		float rot{0.0f};      // radians, clockwise
+		Color tint{255,255,255,255};
+	};
+
+	struct RenderStats {
+		size_t draws{0};
+		size_t quads{0};
+		size_t merged{0};  // texture switches avoided by array pages and slots
+		size_t clipped{0}; // quads dropped entirely by clip
+		size_t culled{0};  // quads outside the context
 	};
 
 	struct PixFont;
+	struct DirtyRect;
+	struct AssetPack;
+	struct StaticLayer;
 
 
 		
@@ -62,14 +220,110 @@ namespace frontend {
 		v2s win_dim{0,0};
 		v2s ctx_dim{0,0};
 
-		// opengl stuff
-		GLuint vao[1];
-		GLuint vbo[1];
-		GLuint prog[1];
+		// opengl stuff; vao/vbo 0: Vertex, 1: ExtVertex
+		GLuint vao[2];
+		GLuint vbo[2];
+		GLuint ebo[1];  // static quad indices
+		GLuint prog[4]{};  // 0: batch, 1: sprite cull (compute), 2: sprite draw, 3: multi-draw
+		GLint u_mode{-1};
+		GLint u_tex_dim{-1};
+		GLint u_offset{-1};
 
 		glm::mat4 proj;
 		Texture white1x1;
+
+		// quads of the frame, sorted by key at flush;
+		// runs with same texture go in one draw
+		std::vector<Quad> quads;
+		std::vector<uint64_t> keys;
+		std::vector<uint64_t> keys_tmp;
+
+		// by texture id: sampled_gen if a pending quad samples it
+		std::vector<uint32_t> sampled;
+		uint32_t sampled_gen{1};
+
+		// draw chunk: 4 vertices per quad, indices fit in uint16
+		static size_t const max_batch_quads = 4096;
+		std::vector<Vertex> verts;
+		std::vector<ExtVertex> ext_verts;
+
+		// texture slots per draw (sampler array size in frag0); slot_count
+		// slots fit GL_MAX_TEXTURE_IMAGE_UNITS with the palette and array
+		// units right after them
+		static int const max_slots = 8;
+		int slot_count{1};
+		int unit_palette{1};
+		int unit_array{2};
+
+		// one draw: quads [begin,end) of chunk starting at quad base, in
+		// the Vertex or ExtVertex stream
+		struct Run {
+			size_t base;
+			size_t begin, end;
+			bool ext;
+			int mode;           // 0: rgba slots, 1: palette, 2: array
+			GLuint tex, pal;    // mode 1,2
+			v2s dim;
+			SamplerOpts samp;   // mode 1,2
+			GLuint slots[max_slots];  // mode 0
+			v2s dims[max_slots];
+			SamplerOpts samps[max_slots];
+			int nslots;
+		};
+		std::vector<Run> runs;
+		std::vector<Slice> slices;
+
+		// textures and samplers bound to units during a draw, u_mode set
+		GLuint bound[max_slots + 2] = {};
+		int bound_samp[max_slots + 2] = {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1};
+		int bound_mode{0};
+
+		// sampler objects by SamplerOpts
+		GLuint samplers[SamplerCount]{};
+		SamplerOpts cur_sampler{SampNearest};
+
+		// array pages by layer size
+		// layers per page fit the byte budget; images needing a page of
+		// fewer than 4 layers get plain textures; pages start small and
+		// double when full
+		static uint16_t const array_layers = 64;
+		static uint16_t const array_first_layers = 4;
+		static size_t const array_page_bytes = 16 << 20;
+		std::vector<TextureArray> arrays;
+
+		// camera: quads are submitted in world coords, drawn at pos - view
+		v2s view{0,0};
+
+		// cut quads straddling the context edge (saves fill on large sprites);
+		// quads fully outside are always dropped
+		bool clip_view{false};
+
+		// draw order layers
+		uint8_t cur_layer{0};
+		std::bitset<256> layer_sorted;
+
+		// clip regions, innermost last; each is the intersection with its parent
+		struct Clip {
+			b2s box;
+			bool scissor;
+		};
+		std::vector<Clip> clips;
+
+		RenderStats stats;       // current frame
+		RenderStats last_stats;  // previous frame
+
+		// preprocessed assets, consulted before decoding files
+		AssetPack const* pack{nullptr};
 		
+		// capabilities
+		bool has_bc{false};  // s3tc block compression
+		bool has_compute{false};  // compute, storage buffers, indirect draw (GL 4.3)
+		bool has_draw_params{false};  // gl_DrawID (ARB_shader_draw_parameters)
+		bool has_buffer_storage{false};  // persistent mapped buffers (GL 4.4)
+		bool has_format_query{false};  // internal format queries (GL 4.3, ARB_internalformat_query2)
+		bool has_bgra{false};  // FormatBGRA pixel uploads (desktop)
+		bool prefer_bgra{false};  // driver converts RGBA uploads to BGRA
+
 		// misc
 		bool verbose{false};
 		bool done{false};
@@ -79,20 +333,113 @@ namespace frontend {
 		~Front();
 		void init(std::string const& title, v2s dim);			
 		
-		void flip() { SDL_GL_SwapWindow(win); }
-
-		Texture make_texture(filesys::Path const& path);
-		Texture make_texture(Image const& img);
-		Texture make_texture(uint8_t const* rgba, v2s dim);
+		// draw pending quads
+		void flush();
+
+		// quads are drawn by layer, then in submission order;
+		// a sorted layer groups its quads by texture instead, use it
+		// for content where overlap order does not matter
+		//
+		// ordering holds only between flushes: scissored push_clip and
+		// pop_clip, draw_layer, GpuSprites::draw, TileMap::draw, clear,
+		// and updating a texture or palette that pending quads sample
+		// all draw the pending quads first, so quads queued before on a
+		// higher layer end up below quads queued after on a lower one
+		void set_layer(uint8_t layer) { cur_layer = layer; }
+		void set_layer_sorted(uint8_t layer, bool sorted);
+
+		// filtering and wrap of following quads; quads with different
+		// samplers still batch (a texture takes one slot per sampler)
+		void set_sampler(SamplerOpts s) { cur_sampler = s; }
+
+		// flush and swap
+		void flip();
+
+		// draw retained quads translated by offset; flushes pending quads
+		// first, re-uploads layer only after it changed
+		void draw_layer(StaticLayer & layer, v2s offset = v2s(0,0));
+
+		// world position shown at context top left; applies to render_*,
+		// sprites, shapes, text and GpuSprites, not to draw_layer (takes
+		// its own offset) nor TileMap::draw (takes offset and view box)
+		void set_view(v2s pos) { view = pos; }
+		v2s get_view() const { return view; }
+
+		// visible world box
+		b2s get_view_box() const { return b2s(view, ctx_dim); }
+
+		// restrict drawing to context box (nested clips intersect);
+		// quads are clipped on cpu and keep batching with unclipped ones;
+		// scissor=true flushes and uses GL scissor instead, pick it for
+		// regions with many quads (scrolled lists, text areas)
+		void push_clip(b2s box, bool scissor = false);
+		void pop_clip();
+
+		// pack entries keep their baked format and honour TexMipmap only;
+		// for png TexArray takes precedence and has no mips, TexMask
+		// falls back to rgba for images that are not mask-like
+		Texture make_texture(filesys::Path const& path, TexOpts opts = TexNone);
+		// immutable RGBA8 storage; TexMipmap allocates and fills the mip chain
+		// (SampMipmap), regenerated by update_texture
+		Texture make_texture(Image const& img, TexOpts opts = TexNone);
+		// pixels already in FormatBGRA upload without conversion where supported
+		Texture make_texture(uint8_t const* rgba, v2s dim, TexOpts opts = TexNone, GLenum format = GL_RGBA);
+
+		// block compressed texture (see bcn.hpp); decoded on cpu when unsupported
+		Texture make_compressed_texture(GLenum format, uint8_t const* blocks, v2s dim);
+
+		// single channel coverage, sampled as (v,v,v,v)
+		Texture make_mask_texture(uint8_t const* mask, v2s dim, TexOpts opts = TexNone);
+
+		// palette path; palette swaps need no new index texture
+		IndexedTexture make_indexed_texture(IndexedImage const& img);
+		IndexedTexture make_indexed_texture(filesys::Path const& path);
+		Texture make_palette(std::vector<Color> const& colors);
+		void update_palette(Texture & palette, std::vector<Color> const& colors);
+
+		// image as layer of shared array page (pages padded to power of 2);
+		// quads from one page batch together; layers are kept until exit;
+		// a page holds 4 layers at first and doubles up to its budget;
+		// large images (over 1024x1024 padded) return a plain texture
+		Texture make_array_texture(Image const& img);
+
+		// empty texture with immutable storage; fill with update_texture
+		Texture make_texture(v2s dim);
+
+		// t: plain rgba texture of img size (not mask, index or block compressed)
+		void update_texture(Texture & t, Image const& img, b2s region);
+		void update_texture(Texture & t, Image const& img, DirtyRect & dirty);
 		
 		PixFont make_font(filesys::Path const& path, int adv);
 
 
-		void render_texture(Texture const& t, v2s pos_);
+		void render_texture(Texture const& t, v2s pos);
 		void render_texture(Texture const& t, v2s trg, b2s src);
 		void render_texture(Texture const& t, v2s trg, b2s src, Color fg);
 
-		//void render_texture(Texture const& t, b2s trg, b2s src, Color fg);
+		void render_texture(IndexedTexture const& t, v2s trg, b2s src);
+		void render_texture(IndexedTexture const& t, v2s trg, b2s src, Texture const& palette);
+
+		// src stretched over trg
+		void render_texture(Texture const& t, b2s trg, b2s src, Color fg = Color(255,255,255,255));
+
+		// frame: corners as is, edges and centre stretched or tiled
+		// (partial last tile cut); all pieces go into the current batch
+		void render_nine_slice(Texture const& t, b2s trg, b2s src, Borders b, bool tile = false, Color fg = Color(255,255,255,255));
+
+		// anti-aliased sdf shapes, one quad each, batched with textured quads;
+		// line > 0 draws an outline of that width instead of filling;
+		// rects and circles are cut by cpu clips, sloped lines are only
+		// culled (use a scissor clip)
+		void render_rect(b2s box, Color c, float radius = 0.0f, float line = 0.0f);
+		void render_circle(v2s center, float r, Color c, float line = 0.0f);
+		void render_line(v2s a, v2s b, float width, Color c);  // round caps
+
+		// scaled and rotated; unrotated sprites snap to whole pixels and
+		// are cut by cpu clips, rotated ones are only culled by bounds
+		// (use a scissor clip for rotated content); scaled corners must
+		// stay within 4095 pixels of pos
+		void render_sprite(Texture const& t, Sprite const& s);
 
 		void render_fill(b2s box, Color c);
 
@@ -102,11 +449,35 @@ namespace frontend {
 
 		void clear();
 
+		// true if pending quads sample texture id
+		bool uses_texture(GLuint id) const;
+
+		// call before changing contents of texture id
+		void flush_if_sampled(GLuint id);
+
+		// Vertex (or ExtVertex) attribute pointers for bound VAO and
+		// array buffer, first vertex at byte offset base
+		void set_vertex_format(size_t base, bool ext = false);
+
+		// rows of 4-byte pixels (stride in pixels) into region of bound
+		// GL_TEXTURE_2D level 0; format GL_RGBA or FormatBGRA (has_bgra)
+		void upload_pixels(v2s pos, v2s dim, uint8_t const* px, int16_t stride, GLenum format = GL_RGBA);
+
 	private:
-		void set_blend_font(Color c);
-		void set_blend_norm();
-		void render_subtexture(Texture const& t, v2s trg, b2s src);
-		void _render_call_GL(GLenum tex_id, GLfloat * data, size_t size);
+		void render_subtexture(Texture const& t, GLuint pal, v2s trg, b2s src, Color c);
+		void push_quad(Texture const& t, GLuint pal, v2s pos, v2s end, v2s uv0, v2s uv1, Color c);
+		bool place_quad(v2s & pos, v2s & end, v2s & uv0, v2s & uv1);
+		void queue_quad(Quad q);
+		bool cull_bounds(v2s & pos, float r);
+		void push_shape(v2s pos, float x0, float y0, float x1, float y1, float radius, float line, float rot, Color c);
+		void set_scissor();
+
+		void build_runs(std::vector<Run> & runs, std::vector<Vertex> & verts, std::vector<ExtVertex> & ext_verts, Quad const* qs, uint64_t const* order, size_t n, size_t base);
+		void draw_runs(Run const* rs, size_t n);
+		void reset_binds();
+		void update_layer(StaticLayer & layer);
+		bool upload_region(Texture const& t, Image const& img, b2s region);
+		void grow_array(TextureArray & a, uint16_t capacity);
 
 		void create_SDL(std::string const& title, v2s dim);
 		void destroy_SDL();
@@ -128,6 +499,36 @@ namespace frontend {
 
 	Image load_png(filesys::Path const& path);
 
+	// false if png is not a palette image
+	bool load_png_indexed(IndexedImage & out, filesys::Path const& path);
+
+	// true if every pixel other than ignore is premultiplied white (v,v,v,v)
+	bool is_mask(Image const& img, Color ignore);
+
+	// coverage of mask-like image; ignored colour becomes 0
+	std::vector<uint8_t> to_mask(Image const& img, Color ignore);
+
+	Quad make_quad(Texture const& t, GLuint pal, v2s pos, v2s end, v2s uv0, v2s uv1, Color c);
+
+	// sampler for quad: palette lookups stay nearest, mips only if present,
+	// no repeat on padded array layers; linear filtering there reads the
+	// page padding at the image edge (keep a transparent border)
+	SamplerOpts fit_sampler(SamplerOpts s, Quad const& q);
+
+	// pieces of nine-slice frame, appended to out;
+	// target smaller than the borders squeezes the whole corner art
+	// proportionally into it
+	void nine_slice(std::vector<Slice> & out, b2s trg, b2s src, Borders b, bool tile);
+
+	// cut quad pos..end to clip, moving uv0..uv1 along;
+	// false if nothing is left
+	bool clip_quad(b2s clip, v2s & pos, v2s & end, v2s & uv0, v2s & uv1);
+
+	// move quad from world to context coords of size dim (int32, no wrap
+	// for far worlds); cuts it to the context when clip is set or when it
+	// would not fit int16; false if it is outside
+	bool view_quad(v2s view, v2s dim, bool clip, v2s & pos, v2s & end, v2s & uv0, v2s & uv1);
+
 }
 
 #include "pixfont.hpp"
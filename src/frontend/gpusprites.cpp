@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cstring>
+#include "gpusprites.hpp"
+#include "my.hpp"
+
+namespace frontend {
+
+	GpuSprites::GpuSprites(Front & front, Texture const& tex, uint32_t capacity):
+		front(front), tex(tex), capacity(capacity)
+	{
+		if (not front.has_compute) {
+			ext::fail("ERROR: GpuSprites: compute shaders not supported\n");
+		}
+		// vert2/frag2 sample a sampler2D
+		if (tex.target != GL_TEXTURE_2D) {
+			ext::fail("ERROR: GpuSprites: array page textures not supported\n");
+		}
+
+		#ifndef __EMSCRIPTEN__
+		glGenBuffers(3, buf);
+		glGenVertexArrays(1, &vao);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buf[0]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GpuSprite), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buf[1]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buf[2]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		CHECK_GL();
+
+		u_count = myGetUniformLocation(front.prog[1], "u_count");
+		u_view = myGetUniformLocation(front.prog[1], "u_view");
+		u_offset = myGetUniformLocation(front.prog[2], "u_offset");
+		u_tex_dim = myGetUniformLocation(front.prog[2], "u_tex_dim");
+		#endif
+	}
+
+	GpuSprites::~GpuSprites() {
+		#ifndef __EMSCRIPTEN__
+		glDeleteBuffers(3, buf);
+		glDeleteVertexArrays(1, &vao);
+		#endif
+	}
+
+	void GpuSprites::touch(Handle h) {
+		if (not is_dirty[h]) {
+			is_dirty[h] = true;
+			dirty.push_back(h);
+		}
+	}
+
+	GpuSprites::Handle GpuSprites::add(v2s pos, b2s src, Color tint) {
+		Handle h;
+		if (free.empty()) {
+			if (sprites.size() == capacity) {
+				ext::fail("ERROR: GpuSprites: capacity exceeded: %||\n", capacity);
+			}
+			h = Handle(sprites.size());
+			sprites.emplace_back();
+			is_dirty.push_back(false);
+		}
+		else {
+			h = free.back();
+			free.pop_back();
+		}
+		set(h, pos, src, tint);
+		return h;
+	}
+
+	void GpuSprites::set(Handle h, v2s pos, b2s src, Color tint) {
+		assert(h < sprites.size());
+		auto & s = sprites[h];
+		s.rect[0] = pos[0];
+		s.rect[1] = pos[1];
+		s.rect[2] = src.dim[0];
+		s.rect[3] = src.dim[1];
+		s.uv[0] = src.pos[0];
+		s.uv[1] = src.pos[1];
+		s.uv[2] = src.pos[0] + src.dim[0];
+		s.uv[3] = src.pos[1] + src.dim[1];
+		memcpy(&s.tint, &tint, sizeof(s.tint));
+		s.alive = 1;
+		touch(h);
+	}
+
+	void GpuSprites::set_pos(Handle h, v2s pos) {
+		assert(h < sprites.size() and sprites[h].alive);
+		auto & s = sprites[h];
+		s.rect[0] = pos[0];
+		s.rect[1] = pos[1];
+		touch(h);
+	}
+
+	void GpuSprites::remove(Handle h) {
+		// a second remove would put h on the free list twice
+		assert(h < sprites.size() and sprites[h].alive);
+		sprites[h].alive = 0;
+		free.push_back(h);
+		touch(h);
+	}
+
+	void GpuSprites::upload() {
+		stats = Stats();
+		if (dirty.empty()) {
+			return;
+		}
+
+		#ifndef __EMSCRIPTEN__
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buf[0]);
+
+		auto put = [&](size_t a, size_t b) {
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, a * sizeof(GpuSprite), (b - a) * sizeof(GpuSprite), &sprites[a]);
+			stats.uploads += 1;
+			stats.uploaded += b - a;
+		};
+
+		if (dirty.size() * 4 > sprites.size()) {
+			// mostly dirty, one upload is cheaper
+			put(0, sprites.size());
+		}
+		else {
+			// merge neighbours into ranges
+			std::sort(dirty.begin(), dirty.end());
+			size_t a = dirty[0];
+			size_t b = a + 1;
+			for (size_t i = 1; i < dirty.size(); ++i) {
+				if (dirty[i] != b) {
+					put(a, b);
+					a = dirty[i];
+				}
+				b = dirty[i] + 1;
+			}
+			put(a, b);
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		CHECK_GL();
+		#endif
+
+		for (auto h: dirty) {
+			is_dirty[h] = false;
+		}
+		dirty.clear();
+	}
+
+	void GpuSprites::draw() {
+		// keep order with batched quads
+		front.flush();
+		upload();
+
+		if (sprites.empty()) {
+			return;
+		}
+
+		#ifndef __EMSCRIPTEN__
+		auto n = GLuint(sprites.size());
+		auto view = front.get_view_box();
+
+		// cull: reset instance count, compact visible indices
+		GLuint cmd[] = {4, 0, 0, 0};
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buf[2]);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(cmd), cmd);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buf[0]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buf[1]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buf[2]);
+
+		glUseProgram(front.prog[1]);
+		glUniform1ui(u_count, n);
+		glUniform4f(u_view, view.pos[0], view.pos[1], view.dim[0], view.dim[1]);
+		glDispatchCompute((n + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+		CHECK_GL();
+
+		// draw: one strip instance per visible sprite
+		glUseProgram(front.prog[2]);
+		glUniform2f(u_offset, -view.pos[0], -view.pos[1]);
+		auto d = tex.get_store_dim();
+		glUniform2f(u_tex_dim, d[0], d[1]);
+		assert(tex.target == GL_TEXTURE_2D);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, tex.id);
+		glBindVertexArray(vao);
+		glDrawArraysIndirect(GL_TRIANGLE_STRIP, nullptr);
+		CHECK_GL();
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glUseProgram(front.prog[0]);
+		CHECK_GL();
+
+		front.stats.draws += 1;
+		#endif
+	}
+
+}
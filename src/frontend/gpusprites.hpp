@@ -0,0 +1,73 @@
+#pragma once
+#include "front.hpp"
+
+namespace frontend {
+
+	// std430 layout of Sprite in cull1/vert2
+	struct GpuSprite {
+		GLfloat rect[4];   // x y w h, world
+		GLfloat uv[4];     // texel rect u0 v0 u1 v1
+		uint32_t tint;     // Color bytes
+		uint32_t alive;
+		uint32_t _pad[2];
+	};
+
+	struct GpuSprites {
+		/*
+			Sprites of one texture kept in a shader storage buffer.
+			Only changed records are uploaded (dirty list, merged into ranges);
+			a compute pass culls all records against the Front view and
+			writes the visible list and instance count of an indirect draw.
+			CPU cost per frame follows the number of changed sprites.
+
+			Desktop only, needs Front::has_compute. The texture must be a
+			plain 2D texture, not a layer of an array page.
+		*/
+
+		using Handle = uint32_t;
+
+		struct Stats {
+			size_t uploads{0};   // glBufferSubData calls by last draw
+			size_t uploaded{0};  // records uploaded by last draw
+		};
+
+		GpuSprites(Front & front, Texture const& tex, uint32_t capacity);
+		GpuSprites(GpuSprites const&) = delete;
+		~GpuSprites();
+
+		Handle add(v2s pos, b2s src, Color tint = Color(255,255,255,255));
+		void set(Handle h, v2s pos, b2s src, Color tint = Color(255,255,255,255));
+		void set_pos(Handle h, v2s pos);
+		void remove(Handle h);  // h must be live, as for set_pos
+
+		size_t size() const { return sprites.size() - free.size(); }
+
+		// flush front, upload changes, cull and draw
+		void draw();
+
+		Stats const& get_stats() const { return stats; }
+
+	private:
+		Front & front;
+		Texture const& tex;
+		uint32_t capacity;
+
+		std::vector<GpuSprite> sprites;  // cpu copy
+		std::vector<Handle> free;
+		std::vector<Handle> dirty;
+		std::vector<bool> is_dirty;
+
+		GLuint buf[3]{};  // sprites, visible list, indirect command
+		GLuint vao{0};
+		GLint u_count{-1};
+		GLint u_view{-1};
+		GLint u_offset{-1};
+		GLint u_tex_dim{-1};
+
+		Stats stats;
+
+		void touch(Handle h);
+		void upload();
+	};
+
+}
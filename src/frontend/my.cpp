@@ -1,3 +1,4 @@
+#include <cstring>
 #include "my.hpp"
 
 #include "../ext/ext.hpp"
@@ -108,6 +109,21 @@ void myShowGLInfo() {
 
 
 
+bool myHasExtension(char const* name) {
+	GLint n = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+	for (GLint i = 0; i < n; ++i) {
+		auto ext = (char const*)glGetStringi(GL_EXTENSIONS, i);
+		if (ext and strcmp(ext, name) == 0) {
+			return true;
+		}
+	}
+	CHECK_GL();
+	return false;
+}
+
+
+
 void myLinkProgram(GLuint program) {
 	glLinkProgram(program);
 
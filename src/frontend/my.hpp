@@ -27,3 +27,5 @@ GLuint myGetUniformLocation(GLuint prog, char const* name);
 
 
 void myShowGLInfo();
+
+bool myHasExtension(char const* name);
@@ -0,0 +1,319 @@
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pack.hpp"
+#include "bcn.hpp"
+#include "../lodepng/lodepng.h"
+
+namespace frontend {
+
+	size_t const PackAlign = 16;
+
+	size_t pack_align(size_t x) {
+		return (x + PackAlign - 1) & ~(PackAlign - 1);
+	}
+
+	// blobs start after header
+	size_t const PackDataStart = pack_align(sizeof(PackHeader));
+
+	// rgba <-> bgra in place
+	void swap_red_blue(uint8_t * px, size_t n) {
+		for (size_t i = 0; i < n; ++i) {
+			std::swap(px[4*i], px[4*i + 2]);
+		}
+	}
+
+
+	bool check_pack_entry(PackEntry const& e, size_t len, size_t glyph_count) {
+		if (e.dim[0] <= 0 or e.dim[1] <= 0) {
+			return false;
+		}
+		if (e.offset < PackDataStart or size_t(e.offset) + e.size > len) {
+			return false;
+		}
+
+		// enough pixels for dim once decoded
+		auto need = get_texture_bytes(e.format, v2s(e.dim[0], e.dim[1]));
+		switch (e.codec) {
+			case PackRaw:
+				if (e.size < need) {
+					return false;
+				}
+				break;
+			case PackZlib:
+				if (e.raw_size < need) {
+					return false;
+				}
+				break;
+			default:
+				return false;
+		}
+
+		return uint64_t(e.glyph_first) + e.glyph_count <= glyph_count;
+	}
+
+	bool AssetPack::open(filesys::Path const& path) {
+		assert(base == nullptr);
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			ext::fail("ERROR: AssetPack: cannot stat: %||\n", path);
+		}
+
+		len = size_t(st.st_size);
+		if (len < sizeof(PackHeader)) {
+			::close(fd);
+			ext::fail("ERROR: AssetPack: file too short: %||\n", path);
+		}
+
+		auto p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) {
+			ext::fail("ERROR: AssetPack: mmap failed: %||\n", path);
+		}
+
+		base = (uint8_t const*)p;
+		header = (PackHeader const*)base;
+
+		if (header->magic != PackMagic or header->version != PackVersion) {
+			close();
+			ext::fail("ERROR: AssetPack: bad header (rebake pack?): %||\n", path);
+		}
+
+		if (size_t(header->index_offset) + header->count * sizeof(PackEntry) > len or
+			size_t(header->glyph_offset) + header->glyph_count * sizeof(PackGlyph) > len)
+		{
+			close();
+			ext::fail("ERROR: AssetPack: truncated: %||\n", path);
+		}
+
+		entries = (PackEntry const*)(base + header->index_offset);
+		glyphs = (PackGlyph const*)(base + header->glyph_offset);
+
+		for (uint32_t i = 0; i < header->count; ++i) {
+			auto & e = entries[i];
+			auto name = std::string(e.name, strnlen(e.name, sizeof(e.name)));
+			if (not check_pack_entry(e, len, header->glyph_count)) {
+				close();
+				ext::fail("ERROR: AssetPack: %||: bad entry: %||\n", path, name);
+			}
+			index[name] = &e;
+		}
+
+		return true;
+	}
+
+	void AssetPack::close() {
+		if (base) {
+			munmap((void*)base, len);
+		}
+		base = nullptr;
+		len = 0;
+		header = nullptr;
+		entries = nullptr;
+		glyphs = nullptr;
+		index.clear();
+	}
+
+	PackEntry const* AssetPack::find(std::string const& name) const {
+		auto it = index.find(name);
+		if (it == index.end()) {
+			return nullptr;
+		}
+		return it->second;
+	}
+
+	uint8_t const* AssetPack::get_pixels(PackEntry const& e, std::vector<uint8_t> & buf) const {
+		auto p = base + e.offset;
+		switch (e.codec) {
+			case PackRaw:
+				return p;
+			case PackZlib: {
+				buf.clear();
+				buf.reserve(e.raw_size);
+				auto err = lodepng::decompress(buf, p, e.size);
+				if (err or buf.size() != e.raw_size) {
+					ext::fail("ERROR: AssetPack: %||: corrupted entry\n", e.name);
+				}
+				return buf.data();
+			}
+		}
+		ext::fail("ERROR: AssetPack: %||: unknown codec %||\n", e.name, e.codec);
+	}
+
+	Texture AssetPack::make_texture(Front & front, PackEntry const& e, TexOpts opts) const {
+		std::vector<uint8_t> buf;
+		auto p = get_pixels(e, buf);
+		auto dim = v2s(e.dim[0], e.dim[1]);
+		if (is_compressed_format(e.format)) {
+			return front.make_compressed_texture(e.format, p, dim);
+		}
+		if (e.format == GL_R8) {
+			return front.make_mask_texture(p, dim, opts);
+		}
+		if (e.format == FormatBGRA) {
+			if (front.has_bgra) {
+				return front.make_texture(p, dim, opts, FormatBGRA);
+			}
+			// webgl: back to rgba on cpu
+			std::vector<uint8_t> rgba(p, p + get_texture_bytes(GL_RGBA, dim));
+			swap_red_blue(rgba.data(), rgba.size() / 4);
+			return front.make_texture(rgba.data(), dim, opts);
+		}
+		return front.make_texture(p, dim, opts);
+	}
+
+	void AssetPack::load_font(Front & front, PixFont & font, PackEntry const& e) const {
+		if (e.kind != PackFont) {
+			ext::fail("ERROR: AssetPack: %||: not a font\n", e.name);
+		}
+
+		font.glyphs.clear();
+		for (uint32_t i = 0; i < e.glyph_count; ++i) {
+			auto & g = glyphs[e.glyph_first + i];
+			font.glyphs[g.code].rect = b2s(v2s(g.rect[0], g.rect[1]), v2s(g.rect[2], g.rect[3]));
+		}
+		font.height = e.font_height;
+		font.img = make_texture(front, e);
+	}
+
+
+
+
+	PackEntry & PackWriter::add_blob(std::string const& name, uint8_t const* p, size_t size, v2s dim, GLenum format) {
+		if (name.size() >= sizeof(PackEntry::name)) {
+			ext::fail("ERROR: PackWriter: name too long: %||\n", name);
+		}
+
+		PackEntry e;
+		memset(&e, 0, sizeof(e));
+		memcpy(e.name, name.data(), name.size());
+		e.kind = PackImage;
+		e.format = format;
+		e.dim[0] = dim[0];
+		e.dim[1] = dim[1];
+		e.raw_size = uint32_t(size);
+
+		std::vector<uint8_t> z;
+		if (compress) {
+			auto err = lodepng::compress(z, p, size);
+			if (err) {
+				ext::fail("ERROR: lodepng: %||: %||\n", lodepng_error_text(err), name);
+			}
+		}
+
+		// keep compressed only when it pays off
+		if (compress and z.size() < size) {
+			e.codec = PackZlib;
+			p = z.data();
+			size = z.size();
+		}
+		else {
+			e.codec = PackRaw;
+		}
+
+		auto off = pack_align(data.size());
+		data.resize(off + size);
+		memcpy(&data[off], p, size);
+
+		e.offset = uint32_t(PackDataStart + off);
+		e.size = uint32_t(size);
+
+		entries.push_back(e);
+		return entries.back();
+	}
+
+	void PackWriter::add_image(std::string const& name, Image const& img, GLenum format) {
+		auto d = img.get_dim();
+		if (is_compressed_format(format)) {
+			std::vector<uint8_t> blocks;
+			encode_bc(blocks, format, img);
+			add_blob(name, blocks.data(), blocks.size(), d, format);
+			return;
+		}
+		if (format == GL_R8) {
+			auto mask = to_mask(img, Color(0,0,0,0));
+			add_blob(name, mask.data(), mask.size(), d, format);
+			return;
+		}
+		auto size = size_t(d[0]) * size_t(d[1]) * sizeof(Color);
+		if (format == FormatBGRA) {
+			std::vector<uint8_t> bgra((uint8_t const*)&img({0,0}), (uint8_t const*)&img({0,0}) + size);
+			swap_red_blue(bgra.data(), bgra.size() / 4);
+			add_blob(name, bgra.data(), size, d, FormatBGRA);
+			return;
+		}
+		add_blob(name, (uint8_t const*)&img({0,0}), size, d, GL_RGBA);
+	}
+
+	void PackWriter::add_font(std::string const& name, Image const& img, PixFont const& font) {
+		auto d = img.get_dim();
+		auto fc = img(v2s(0,0));
+
+		PackEntry * ep;
+		if (is_mask(img, fc)) {
+			auto mask = to_mask(img, fc);
+			ep = &add_blob(name, mask.data(), mask.size(), d, GL_R8);
+		}
+		else {
+			auto size = size_t(d[0]) * size_t(d[1]) * sizeof(Color);
+			ep = &add_blob(name, (uint8_t const*)&img({0,0}), size, d, GL_RGBA);
+		}
+		auto & e = *ep;
+
+		e.kind = PackFont;
+		e.font_height = font.height;
+		e.glyph_first = uint32_t(glyphs.size());
+		e.glyph_count = uint32_t(font.glyphs.size());
+
+		for (auto & kv: font.glyphs) {
+			auto & r = kv.second.rect;
+			PackGlyph g;
+			g.code = kv.first;
+			g.rect[0] = r.pos[0];
+			g.rect[1] = r.pos[1];
+			g.rect[2] = r.dim[0];
+			g.rect[3] = r.dim[1];
+			glyphs.push_back(g);
+		}
+	}
+
+	void PackWriter::write(filesys::Path const& path) const {
+		PackHeader h;
+		memset(&h, 0, sizeof(h));
+		h.magic = PackMagic;
+		h.version = PackVersion;
+		h.count = uint32_t(entries.size());
+		h.index_offset = uint32_t(PackDataStart + pack_align(data.size()));
+		h.glyph_offset = uint32_t(h.index_offset + entries.size() * sizeof(PackEntry));
+		h.glyph_count = uint32_t(glyphs.size());
+
+		std::ofstream f(path, std::ios::binary);
+		if (!f) {
+			ext::fail("ERROR: PackWriter: cannot open for writing: %||\n", path);
+		}
+
+		std::vector<char> pad(PackAlign, 0);
+
+		f.write((char const*)&h, sizeof(h));
+		f.write(pad.data(), PackDataStart - sizeof(h));
+		f.write((char const*)data.data(), data.size());
+		f.write(pad.data(), pack_align(data.size()) - data.size());
+		f.write((char const*)entries.data(), entries.size() * sizeof(PackEntry));
+		f.write((char const*)glyphs.data(), glyphs.size() * sizeof(PackGlyph));
+
+		if (!f) {
+			ext::fail("ERROR: PackWriter: write failed: %||\n", path);
+		}
+	}
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <unordered_map>
+#include "front.hpp"
+
+namespace frontend {
+
+	/*
+		Asset pack: preprocessed images and fonts ready for upload.
+
+		layout:
+			PackHeader
+			data blobs (each 16-byte aligned)
+			PackEntry[count]
+			PackGlyph[...]
+
+		Images are stored as decoded RGBA pixels, R8 coverage masks or
+		S3TC blocks (optionally zlib compressed); fonts are images with
+		a precomputed glyph table.
+		Entries are looked up by name (path of the source png).
+	*/
+
+	uint32_t const PackMagic = 0x4b415046;  // "FPAK"
+	uint32_t const PackVersion = 1;
+
+	enum PackKind: uint32_t {
+		PackImage = 0,
+		PackFont = 1,
+	};
+
+	enum PackCodec: uint32_t {
+		PackRaw = 0,
+		PackZlib = 1,
+	};
+
+	struct PackHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t count;
+		uint32_t index_offset;
+		uint32_t glyph_offset;
+		uint32_t glyph_count;
+	};
+
+	struct PackEntry {
+		char name[64];
+		uint32_t kind;
+		uint32_t codec;
+		uint32_t format;     // GL_RGBA, FormatBGRA, GL_R8 or block compressed format
+		int16_t dim[2];
+		uint32_t offset;     // data blob
+		uint32_t size;       // stored size
+		uint32_t raw_size;   // size after decompression
+		uint32_t glyph_first;
+		uint32_t glyph_count;
+		int32_t font_height;
+	};
+
+	struct PackGlyph {
+		uint32_t code;
+		int16_t rect[4];   // x y w h
+	};
+
+
+	// entry data lies in a mapping of len bytes after the header, holds
+	// the pixels its dim needs, glyphs lie in a table of glyph_count
+	bool check_pack_entry(PackEntry const& e, size_t len, size_t glyph_count);
+
+
+	struct AssetPack {
+		AssetPack() = default;
+		AssetPack(AssetPack const&) = delete;
+		~AssetPack() { close(); }
+
+		// map pack file; false if file does not exist, fails on a
+		// truncated pack or an entry out of bounds
+		bool open(filesys::Path const& path);
+		void close();
+
+		PackEntry const* find(std::string const& name) const;
+
+		// pixels of entry; points into the mapping for raw entries
+		uint8_t const* get_pixels(PackEntry const& e, std::vector<uint8_t> & buf) const;
+
+		// opts: TexMipmap honoured for rgba and mask entries
+		Texture make_texture(Front & front, PackEntry const& e, TexOpts opts = TexNone) const;
+		void load_font(Front & front, PixFont & font, PackEntry const& e) const;
+
+	private:
+		uint8_t const* base{nullptr};
+		size_t len{0};
+		PackHeader const* header{nullptr};
+		PackEntry const* entries{nullptr};
+		PackGlyph const* glyphs{nullptr};
+		std::unordered_map<std::string, PackEntry const*> index;
+	};
+
+
+	struct PackWriter {
+		/*
+			Collects entries in memory, writes pack at once
+		*/
+
+		bool compress{false};
+
+		// format: GL_RGBA, FormatBGRA (stored swizzled for drivers that
+		// prefer it), GL_R8 (mask-like only) or FormatBC1/FormatBC3
+		void add_image(std::string const& name, Image const& img, GLenum format = GL_RGBA);
+		void add_font(std::string const& name, Image const& img, PixFont const& font);
+
+		void write(filesys::Path const& path) const;
+
+		size_t get_count() const { return entries.size(); }
+		size_t get_data_size() const { return data.size(); }
+
+	private:
+		std::vector<PackEntry> entries;
+		std::vector<PackGlyph> glyphs;
+		std::vector<uint8_t> data;
+
+		PackEntry & add_blob(std::string const& name, uint8_t const* p, size_t size, v2s dim, GLenum format);
+	};
+
+}
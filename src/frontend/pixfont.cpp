@@ -1,5 +1,6 @@
 #include <fstream>
 #include "pixfont.hpp"
+#include "pack.hpp"
 
 namespace frontend {
 
@@ -65,19 +66,13 @@ namespace frontend {
 		ext::fail("PixFontLoader: next_char: eof while scanning lst file");
 	}
 
-	void load_pixfont(Front & front, PixFont & font, filesys::Path const& path_png) {
+	void scan_pixfont(PixFont & font, Image const& img, filesys::Path const& path_lst) {
 		/* 
-			This function expects 2 files:
-			png: glyphs
+			img: glyphs
 			lst: coresponding letters			
 		*/
-		 
-		// filesys maneuvers
-		auto path_lst = format("%||.lst", path_png.substr(0, path_png.size()-4));			
 		std::ifstream lst(path_lst);
 		//print("%||\n", path_lst);
-
-		Image img = load_png(path_png);
 						
 		v2s g_pos(0,0);
 		int16_t line_height{-1};
@@ -105,8 +100,38 @@ namespace frontend {
 		}
 		
 		font.height = line_height;
+	}
+
+	filesys::Path get_lst_path(filesys::Path const& path_png) {
+		return format("%||.lst", path_png.substr(0, path_png.size()-4));
+	}
+
+	void load_pixfont(Front & front, PixFont & font, filesys::Path const& path_png) {
+		/* 
+			This function expects 2 files:
+			png: glyphs
+			lst: coresponding letters			
+		*/
+		if (front.pack) {
+			if (auto e = front.pack->find(path_png)) {
+				front.pack->load_font(front, font, *e);
+				return;
+			}
+		}
 
-		font.img = front.make_texture(img);
+		Image img = load_png(path_png);
+
+		scan_pixfont(font, img, get_lst_path(path_png));
+
+		// frame is never sampled, glyph sheets are usually coverage only
+		auto fc = img(v2s(0,0));
+		if (is_mask(img, fc)) {
+			auto mask = to_mask(img, fc);
+			font.img = front.make_mask_texture(mask.data(), img.get_dim());
+		}
+		else {
+			font.img = front.make_texture(img);
+		}
 	}
 
 }
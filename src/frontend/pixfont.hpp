@@ -8,6 +8,12 @@ namespace frontend {
 
 	void load_pixfont(Front & front, PixFont & font, filesys::Path const& path_png);
 
+	// fill glyph boxes and height from glyph sheet and its letter list
+	void scan_pixfont(PixFont & font, Image const& img, filesys::Path const& path_lst);
+
+	// glyph sheet foo.png -> letter list foo.lst
+	filesys::Path get_lst_path(filesys::Path const& path_png);
+
 	struct PixFont{
 		
 		struct PixGlyph{
@@ -0,0 +1,49 @@
+#include "radix.hpp"
+#include <utility>
+
+namespace frontend {
+
+	void radix_sort(std::vector<uint64_t> & keys, std::vector<uint64_t> & tmp) {
+		auto n = keys.size();
+		if (n < 2) {
+			return;
+		}
+		tmp.resize(n);
+
+		// histograms for all 8 bytes in one pass
+		size_t hist[8][256] = {};
+		for (auto k: keys) {
+			for (int b = 0; b < 8; ++b) {
+				++hist[b][(k >> (8*b)) & 0xff];
+			}
+		}
+
+		auto * src = &keys;
+		auto * dst = &tmp;
+		for (int b = 0; b < 8; ++b) {
+			auto & h = hist[b];
+
+			// all keys in one bucket: nothing to do
+			if (h[((*src)[0] >> (8*b)) & 0xff] == n) {
+				continue;
+			}
+
+			size_t sum = 0;
+			for (auto & x: h) {
+				auto c = x;
+				x = sum;
+				sum += c;
+			}
+
+			for (auto k: *src) {
+				(*dst)[h[(k >> (8*b)) & 0xff]++] = k;
+			}
+			std::swap(src, dst);
+		}
+
+		if (src != &keys) {
+			keys.swap(tmp);
+		}
+	}
+
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace frontend {
+
+	// stable LSD radix sort, 8 bits per pass; passes where all keys
+	// share the byte are skipped; tmp is scratch space
+	void radix_sort(std::vector<uint64_t> & keys, std::vector<uint64_t> & tmp);
+
+}
@@ -6,18 +6,58 @@ namespace shader
 char const* vert0 = R"(
 	#version 300 es
 
-	precision mediump float;
+	precision highp float;
 
 	uniform mat4 m_proj;
+	uniform vec2 u_tex_dim[8];
+	uniform vec2 u_offset;
 	
 	layout(location = 0) in vec2 a_xy;	
 	layout(location = 1) in vec2 a_uv;	
+	layout(location = 2) in vec4 a_tint;
+	layout(location = 3) in float a_layer;
+	layout(location = 4) in float a_slot;
+	layout(location = 5) in vec2 a_off;   // 1/8 pixel
+	layout(location = 6) in float a_rot;  // turns * 65536
+	layout(location = 7) in float a_line;
 	out vec2 v_uv;
+	out vec4 v_tint;
+	flat out float v_layer;
+	flat out int v_slot;
+
+	// shapes (slot 254, 255): pixels from centre, half size, radius and line width
+	out vec2 v_local;
+	flat out vec2 v_half;
+	flat out vec2 v_shape;
 	
 	void main()
 	{
-		gl_Position = m_proj * vec4(a_xy.x, a_xy.y, 0.0, 1.0);
-		v_uv = a_uv;
+		int slot = int(a_slot);
+
+		// rotate corner offset around x,y; y points down, so clockwise;
+		// axis aligned shapes keep their half size there instead
+		float a = a_rot * (6.2831853 / 65536.0);
+		float c = cos(a);
+		float s = sin(a);
+		vec2 o = (slot == 254) ? vec2(0.0) : a_off * 0.125;
+		vec2 xy = a_xy + vec2(c * o.x - s * o.y, s * o.x + c * o.y);
+		gl_Position = m_proj * vec4(xy + u_offset, 0.0, 1.0);
+		if (slot >= 254) {
+			// rotated corners are 1 pixel out of the shape for the soft edge
+			v_local = (a_uv - 32768.0) * 0.5;
+			v_half = (slot == 254) ? a_off * 0.125 : abs(v_local) - 1.0;
+			v_shape = vec2(a_layer, a_line) * 0.5;
+			v_uv = vec2(0.0);
+		}
+		else {
+			v_local = vec2(0.0);
+			v_half = vec2(0.0);
+			v_shape = vec2(0.0);
+			v_uv = a_uv / u_tex_dim[slot];
+		}
+		v_tint = a_tint;
+		v_layer = a_layer;
+		v_slot = slot;
 	}
 )";
 
@@ -28,18 +68,195 @@ char const* frag0 = R"(
 
 	precision mediump float;
 
+	precision mediump sampler2DArray;
+
 	in vec2 v_uv;
+	in vec4 v_tint;
+	flat in float v_layer;
+	flat in int v_slot;
+	in highp vec2 v_local;
+	flat in highp vec2 v_half;
+	flat in highp vec2 v_shape;
 
 	layout(location = 0) out vec4 outcolor;
 	
-	uniform sampler2D s_texture;
+	uniform sampler2D s_texture[8];
+	uniform sampler2D s_palette;
+	uniform sampler2DArray s_array;
+	
+	// 0: rgba, 1: palette index in red, 2: array layer
+	uniform int u_mode;
+	
+	// sampler arrays take constant indices only
+	vec4 sample_slot(int s, vec2 uv)
+	{
+		switch (s) {
+			case 0: return texture(s_texture[0], uv);
+			case 1: return texture(s_texture[1], uv);
+			case 2: return texture(s_texture[2], uv);
+			case 3: return texture(s_texture[3], uv);
+			case 4: return texture(s_texture[4], uv);
+			case 5: return texture(s_texture[5], uv);
+			case 6: return texture(s_texture[6], uv);
+			default: return texture(s_texture[7], uv);
+		}
+	}
+	
+	// rounded box of half size h, corner radius r
+	highp float sd_round_box(highp vec2 p, highp vec2 h, highp float r)
+	{
+		highp vec2 q = abs(p) - h + r;
+		return length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - r;
+	}
 	
 	void main()
 	{
-		outcolor = texture(s_texture, v_uv);
+		vec4 c;
+		if (v_slot >= 254) {
+			// rect, circle (r = half size), capsule; band of width line for outlines
+			highp float d = sd_round_box(v_local, v_half, v_shape.x);
+			if (v_shape.y > 0.0) {
+				d = abs(d + 0.5 * v_shape.y) - 0.5 * v_shape.y;
+			}
+			c = vec4(1.0, 1.0, 1.0, clamp(0.5 - d, 0.0, 1.0));
+		}
+		else if (u_mode == 2) {
+			c = texture(s_array, vec3(v_uv, v_layer));
+		}
+		else {
+			c = sample_slot(v_slot, v_uv);
+		}
+		if (u_mode == 1) {
+			int i = int(c.r * 255.0 + 0.5);
+			c = texelFetch(s_palette, ivec2(i, 0), 0);
+		}
+		outcolor = c * v_tint;
 	}
 )";
 
 
 
+// gpu sprites (desktop GL 4.3): cull pass and draw pass over storage buffers
+
+char const* cull1 = R"(
+	#version 430 core
+
+	layout(local_size_x = 64) in;
+
+	struct Sprite {
+		vec4 rect;   // x y w h, world
+		vec4 uv;     // texel rect u0 v0 u1 v1
+		uint tint;
+		uint alive;
+		uint _pad0;
+		uint _pad1;
+	};
+
+	layout(std430, binding = 0) readonly buffer Sprites { Sprite sprites[]; };
+	layout(std430, binding = 1) writeonly buffer Visible { uint visible[]; };
+
+	// DrawArraysIndirectCommand
+	layout(std430, binding = 2) buffer Command {
+		uint count;
+		uint instance_count;
+		uint first;
+		uint base_instance;
+	};
+
+	uniform uint u_count;
+	uniform vec4 u_view;  // x y w h, world
+
+	void main()
+	{
+		uint i = gl_GlobalInvocationID.x;
+		if (i >= u_count) {
+			return;
+		}
+		Sprite s = sprites[i];
+		if (s.alive == 0u) {
+			return;
+		}
+		if (s.rect.x < u_view.x + u_view.z && u_view.x < s.rect.x + s.rect.z &&
+			s.rect.y < u_view.y + u_view.w && u_view.y < s.rect.y + s.rect.w)
+		{
+			visible[atomicAdd(instance_count, 1u)] = i;
+		}
+	}
+)";
+
+char const* vert2 = R"(
+	#version 430 core
+
+	struct Sprite {
+		vec4 rect;
+		vec4 uv;
+		uint tint;
+		uint alive;
+		uint _pad0;
+		uint _pad1;
+	};
+
+	layout(std430, binding = 0) readonly buffer Sprites { Sprite sprites[]; };
+	layout(std430, binding = 1) readonly buffer Visible { uint visible[]; };
+
+	uniform mat4 m_proj;
+	uniform vec2 u_offset;
+	uniform vec2 u_tex_dim;
+
+	out vec2 v_uv;
+	out vec4 v_tint;
+
+	void main()
+	{
+		Sprite s = sprites[visible[gl_InstanceID]];
+
+		// strip corners: (0,0) (0,1) (1,0) (1,1)
+		vec2 k = vec2(float(gl_VertexID >> 1), float(gl_VertexID & 1));
+		gl_Position = m_proj * vec4(s.rect.xy + k * s.rect.zw + u_offset, 0.0, 1.0);
+		v_uv = mix(s.uv.xy, s.uv.zw, k) / u_tex_dim;
+		v_tint = unpackUnorm4x8(s.tint);
+	}
+)";
+
+char const* frag2 = R"(
+	#version 430 core
+
+	in vec2 v_uv;
+	in vec4 v_tint;
+
+	layout(location = 0) out vec4 outcolor;
+
+	uniform sampler2D s_texture;
+
+	void main()
+	{
+		outcolor = texture(s_texture, v_uv) * v_tint;
+	}
+)";
+
+char const* vert3 = R"(
+	#version 430 core
+	#extension GL_ARB_shader_draw_parameters : require
+
+	// multi-draw of batch vertices; per-draw translation by gl_DrawID
+	uniform mat4 m_proj;
+	uniform vec2 u_tex_dim;
+
+	layout(std430, binding = 3) readonly buffer Offsets { vec2 offsets[]; };
+
+	layout(location = 0) in vec2 a_xy;
+	layout(location = 1) in vec2 a_uv;
+	layout(location = 2) in vec4 a_tint;
+
+	out vec2 v_uv;
+	out vec4 v_tint;
+
+	void main()
+	{
+		gl_Position = m_proj * vec4(a_xy + offsets[gl_DrawIDARB], 0.0, 1.0);
+		v_uv = a_uv / u_tex_dim;
+		v_tint = a_tint;
+	}
+)";
+
 }
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include "spatialgrid.hpp"
+
+namespace frontend {
+
+	SpatialGrid::SpatialGrid(int shift): shift(shift) {
+		assert(shift >= 0 and shift < 16);
+	}
+
+	void SpatialGrid::cell_range(b2s box, int32_t * c0, int32_t * c1) const {
+		// v2s range shifted to 0..65535; empty boxes still take one cell
+		for (int k = 0; k < 2; ++k) {
+			int32_t a = int32_t(box.pos[k]) + 32768;
+			int32_t b = a + std::max<int32_t>(box.dim[k], 1) - 1;
+			b = std::min<int32_t>(b, 65535);
+			c0[k] = a >> shift;
+			c1[k] = b >> shift;
+		}
+	}
+
+	void SpatialGrid::link(Handle h) {
+		auto & o = objs[h];
+		for (int32_t y = o.c0[1]; y <= o.c1[1]; ++y) {
+			for (int32_t x = o.c0[0]; x <= o.c1[0]; ++x) {
+				cells[cell_key(x, y)].push_back(h);
+			}
+		}
+	}
+
+	void SpatialGrid::unlink(Handle h) {
+		auto & o = objs[h];
+		for (int32_t y = o.c0[1]; y <= o.c1[1]; ++y) {
+			for (int32_t x = o.c0[0]; x <= o.c1[0]; ++x) {
+				auto ci = cells.find(cell_key(x, y));
+				assert(ci != cells.end());
+				auto & c = ci->second;
+				auto it = std::find(c.begin(), c.end(), h);
+				assert(it != c.end());
+				*it = c.back();
+				c.pop_back();
+				if (c.empty()) {
+					cells.erase(ci);
+				}
+			}
+		}
+	}
+
+	SpatialGrid::Handle SpatialGrid::insert(b2s box, uint32_t data) {
+		Handle h;
+		if (free.empty()) {
+			h = Handle(objs.size());
+			objs.emplace_back();
+		}
+		else {
+			h = free.back();
+			free.pop_back();
+		}
+
+		auto & o = objs[h];
+		o.box = box;
+		o.data = data;
+		o.stamp = 0;
+		cell_range(box, o.c0, o.c1);
+		link(h);
+
+		count += 1;
+		return h;
+	}
+
+	void SpatialGrid::move(Handle h, b2s box) {
+		auto & o = objs[h];
+		assert(o.c0[0] >= 0);
+		o.box = box;
+
+		int32_t c0[2], c1[2];
+		cell_range(box, c0, c1);
+		if (c0[0] == o.c0[0] and c0[1] == o.c0[1] and c1[0] == o.c1[0] and c1[1] == o.c1[1]) {
+			return;
+		}
+
+		unlink(h);
+		std::copy(c0, c0 + 2, o.c0);
+		std::copy(c1, c1 + 2, o.c1);
+		link(h);
+	}
+
+	void SpatialGrid::remove(Handle h) {
+		assert(objs[h].c0[0] >= 0);
+		unlink(h);
+		objs[h].c0[0] = -1;
+		free.push_back(h);
+		count -= 1;
+	}
+
+	void SpatialGrid::query(b2s box, std::vector<Handle> & out) {
+		visit(box, [&](Handle h, b2s, uint32_t) {
+			out.push_back(h);
+		});
+	}
+
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include "front.hpp"
+
+namespace frontend {
+
+	struct SpatialGrid {
+		/*
+			Uniform grid of boxes in world coords, covering the whole v2s range.
+			Only occupied cells are stored (hashed by cell), so memory follows
+			the boxes, not the cell count.
+			Each box is listed in every cell it overlaps; a query visits the
+			cells under the query box and reports each box once (stamped),
+			so its cost follows the visible count, not the total.
+			Moves within the same cell range touch no buckets.
+
+			Typical use feeds the batcher with what the camera sees:
+				grid.visit(front.get_view_box(), [&](Handle h, b2s box, uint32_t data) {
+					front.render_texture(...);
+				});
+		*/
+
+		using Handle = uint32_t;
+		static Handle const None = 0xffffffffu;
+
+		struct Stats {
+			size_t cells{0};    // occupied cells visited by last query
+			size_t tested{0};   // boxes tested by last query
+		};
+
+		// cell side is 1 << shift pixels
+		explicit SpatialGrid(int shift = 8);
+
+		Handle insert(b2s box, uint32_t data = 0);
+		void move(Handle h, b2s box);
+		void remove(Handle h);
+
+		b2s get_box(Handle h) const { return objs[h].box; }
+		uint32_t get_data(Handle h) const { return objs[h].data; }
+		size_t size() const { return count; }
+
+		// handles of boxes overlapping box, appended to out
+		void query(b2s box, std::vector<Handle> & out);
+
+		// f(handle, box, data) for boxes overlapping box
+		template <class F>
+		void visit(b2s box, F f);
+
+		Stats const& get_stats() const { return stats; }
+
+	private:
+		struct Obj {
+			b2s box;
+			uint32_t data;
+			uint32_t stamp;
+			int32_t c0[2], c1[2];  // cell range, inclusive; c0[0] < 0 if free
+		};
+
+		int shift;
+		std::unordered_map<uint32_t, std::vector<Handle>> cells;  // by cell_key
+		std::vector<Obj> objs;
+		std::vector<Handle> free;
+		size_t count{0};
+		uint32_t stamp{0};
+		Stats stats;
+
+		static uint32_t cell_key(int32_t x, int32_t y) { return (uint32_t(y) << 16) | uint32_t(x); }
+
+		void cell_range(b2s box, int32_t * c0, int32_t * c1) const;
+		void link(Handle h);
+		void unlink(Handle h);
+	};
+
+
+	template <class F>
+	void SpatialGrid::visit(b2s box, F f) {
+		// stamp wrap: clear old stamps
+		if (++stamp == 0) {
+			for (auto & o: objs) {
+				o.stamp = 0;
+			}
+			stamp = 1;
+		}
+
+		int32_t c0[2], c1[2];
+		cell_range(box, c0, c1);
+
+		stats = Stats();
+		int32_t bx1 = int32_t(box.pos[0]) + box.dim[0];
+		int32_t by1 = int32_t(box.pos[1]) + box.dim[1];
+
+		auto test = [&](std::vector<Handle> const& c) {
+			stats.cells += 1;
+			for (auto h: c) {
+				auto & o = objs[h];
+				if (o.stamp == stamp) {
+					continue;
+				}
+				o.stamp = stamp;
+				stats.tested += 1;
+
+				auto & b = o.box;
+				if (b.pos[0] < bx1 and box.pos[0] < b.pos[0] + b.dim[0] and
+					b.pos[1] < by1 and box.pos[1] < b.pos[1] + b.dim[1])
+				{
+					f(h, b, o.data);
+				}
+			}
+		};
+
+		auto n = size_t(c1[0] - c0[0] + 1) * size_t(c1[1] - c0[1] + 1);
+		if (n > cells.size()) {
+			// range larger than the occupied cells, walk those instead
+			for (auto & kv: cells) {
+				int32_t x = int32_t(kv.first & 0xffff);
+				int32_t y = int32_t(kv.first >> 16);
+				if (x >= c0[0] and x <= c1[0] and y >= c0[1] and y <= c1[1]) {
+					test(kv.second);
+				}
+			}
+			return;
+		}
+
+		for (int32_t y = c0[1]; y <= c1[1]; ++y) {
+			for (int32_t x = c0[0]; x <= c1[0]; ++x) {
+				auto it = cells.find(cell_key(x, y));
+				if (it != cells.end()) {
+					test(it->second);
+				}
+			}
+		}
+	}
+
+}
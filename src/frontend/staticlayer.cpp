@@ -0,0 +1,40 @@
+#include "staticlayer.hpp"
+
+namespace frontend {
+
+	StaticLayer::~StaticLayer() {
+		if (vao != 0) {
+			glDeleteBuffers(1, &vbo);
+			glDeleteVertexArrays(1, &vao);
+		}
+	}
+
+	void StaticLayer::push(Quad q) {
+		// sampler is fixed at recording
+		q.sampler = fit_sampler(front.cur_sampler, q);
+		quads.push_back(q);
+		dirty = true;
+	}
+
+	void StaticLayer::add(Texture const& t, v2s trg, b2s src, Color c) {
+		push(make_quad(t, 0, trg, v2s(trg + src.dim), src.pos, v2s(src.pos + src.dim), c));
+	}
+
+	void StaticLayer::add(Texture const& t, v2s pos) {
+		add(t, pos, b2s(v2s(0,0), t.dim));
+	}
+
+	void StaticLayer::add(IndexedTexture const& t, v2s trg, b2s src) {
+		push(make_quad(t.index, t.palette.id, trg, v2s(trg + src.dim), src.pos, v2s(src.pos + src.dim), Color(255,255,255,255)));
+	}
+
+	void StaticLayer::add_fill(b2s box, Color c) {
+		push(make_quad(front.white1x1, 0, box.pos, v2s(box.pos + box.dim), v2s(0,0), v2s(1,1), c));
+	}
+
+	void StaticLayer::clear() {
+		quads.clear();
+		dirty = true;
+	}
+
+}
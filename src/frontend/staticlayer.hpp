@@ -0,0 +1,39 @@
+#pragma once
+#include "front.hpp"
+
+namespace frontend {
+
+	struct StaticLayer {
+		/*
+			Quads recorded once and kept in their own vertex buffer.
+			Drawn by Front::draw_layer in recording order; vertices are
+			rebuilt only after the layer changes.
+			Textures must outlive the layer (or be re-recorded).
+		*/
+
+		Front & front;
+
+		std::vector<Quad> quads;
+		std::vector<Front::Run> runs;
+		GLuint vao{0};
+		GLuint vbo{0};
+		bool dirty{true};
+
+		explicit StaticLayer(Front & front): front(front) {}
+		StaticLayer(StaticLayer const&) = delete;
+		~StaticLayer();
+
+		void add(Texture const& t, v2s trg, b2s src, Color c = Color(255,255,255,255));
+		void add(Texture const& t, v2s pos);
+		void add(IndexedTexture const& t, v2s trg, b2s src);
+		void add_fill(b2s box, Color c);
+
+		void clear();
+
+		size_t size() const { return quads.size(); }
+
+	private:
+		void push(Quad q);
+	};
+
+}
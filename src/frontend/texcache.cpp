@@ -0,0 +1,97 @@
+#include <climits>
+#include <cstdlib>
+#include "texcache.hpp"
+
+namespace frontend {
+
+	std::string canonical_path(filesys::Path const& path) {
+		char buf[PATH_MAX];
+		if (realpath(path.c_str(), buf)) {
+			return std::string(buf);
+		}
+		// missing file; let the loader report it
+		return path;
+	}
+
+	TextureRef TextureCache::get(Front & front, filesys::Path const& path, TexOpts opts) {
+		return get(path, opts, [&](filesys::Path const& p, TexOpts o) {
+			return front.make_texture(p, o);
+		});
+	}
+
+	TextureRef TextureCache::get(filesys::Path const& path, TexOpts opts, Load const& load) {
+		Key key{canonical_path(path), opts};
+
+		auto it = entries.find(key);
+		if (it != entries.end()) {
+			++stats.hits;
+			auto & e = it->second;
+			lru.splice(lru.begin(), lru, e.lru);
+			return e.tex;
+		}
+
+		++stats.misses;
+
+		auto tex = std::make_shared<Texture>(load(path, opts));
+
+		lru.push_front(key);
+
+		Entry e;
+		e.tex = tex;
+		e.bytes = tex->get_bytes();
+		e.lru = lru.begin();
+
+		stats.bytes += e.bytes;
+		entries.emplace(std::move(key), std::move(e));
+
+		trim();
+		return tex;
+	}
+
+	void TextureCache::evict(std::list<Key>::iterator it) {
+		auto e = entries.find(*it);
+		assert(e != entries.end());
+
+		stats.bytes -= e->second.bytes;
+		++stats.evictions;
+
+		entries.erase(e);
+		lru.erase(it);
+	}
+
+	void TextureCache::trim(size_t max_cnt, size_t max_bytes) {
+		size_t cnt = 0;
+		size_t bytes = 0;
+
+		// walk from most recently used, evict unused past the limits
+		auto it = lru.begin();
+		while (it != lru.end()) {
+			auto & e = entries.at(*it);
+			// pending draws may still hold the id after the last ref is gone
+			if (e.tex.use_count() > 1 or is_texture_used(e.tex->id)) {
+				++it;
+				continue;
+			}
+
+			if (cnt + 1 > max_cnt or bytes + e.bytes > max_bytes) {
+				auto dead = it;
+				++it;
+				evict(dead);
+				continue;
+			}
+
+			cnt += 1;
+			bytes += e.bytes;
+			++it;
+		}
+	}
+
+	void TextureCache::trim() {
+		trim(max_unused, max_unused_bytes);
+	}
+
+	void TextureCache::purge() {
+		trim(0, 0);
+	}
+
+}
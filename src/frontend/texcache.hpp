@@ -0,0 +1,90 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include "front.hpp"
+
+namespace frontend {
+
+	using TextureRef = std::shared_ptr<Texture const>;
+
+	struct TextureCache {
+		/*
+			Shares textures loaded from files.
+			Key is canonical path + load options.
+			Entry is unused when cache holds the only reference and no
+			pending draw samples it; unused entries are evicted in LRU
+			order above the limits.
+		*/
+
+		struct Key {
+			std::string path;
+			TexOpts opts;
+
+			bool operator==(Key const& o) const {
+				return path == o.path and opts == o.opts;
+			}
+		};
+
+		struct KeyHash {
+			size_t operator()(Key const& k) const {
+				return std::hash<std::string>()(k.path) ^ (size_t(k.opts) * 0x9e3779b9u);
+			}
+		};
+
+		struct Entry {
+			TextureRef tex;
+			size_t bytes{0};
+			std::list<Key>::iterator lru;
+		};
+
+		struct Stats {
+			size_t hits{0};
+			size_t misses{0};
+			size_t evictions{0};
+			size_t bytes{0};    // all cached textures
+		};
+
+		// limits for unused entries
+		size_t max_unused{64};
+		size_t max_unused_bytes{64 << 20};
+
+		TextureCache() = default;
+		TextureCache(TextureCache const&) = delete;
+
+		// creates the texture of a miss
+		using Load = std::function<Texture (filesys::Path const& path, TexOpts opts)>;
+
+		// opts go to Front::make_texture and are part of the key, so the
+		// same file loaded with other opts is a separate texture;
+		// a miss trims after loading
+		TextureRef get(Front & front, filesys::Path const& path, TexOpts opts = TexNone);
+
+		// load gets path as given (pack entries are named by it), the
+		// canonical path is only the key
+		TextureRef get(filesys::Path const& path, TexOpts opts, Load const& load);
+
+		// evict unused entries above limits; runs only on a miss in get,
+		// call it (e.g. once per frame) to release textures dropped
+		// since without loading new ones
+		void trim();
+
+		// evict all unused entries
+		void purge();
+
+		Stats const& get_stats() const { return stats; }
+		size_t size() const { return entries.size(); }
+
+	private:
+		std::unordered_map<Key, Entry, KeyHash> entries;
+		std::list<Key> lru;  // front is most recently used
+		Stats stats;
+
+		void evict(std::list<Key>::iterator it);
+		void trim(size_t max_cnt, size_t max_bytes);
+	};
+
+	std::string canonical_path(filesys::Path const& path);
+
+}
@@ -0,0 +1,232 @@
+#include <cstring>
+#include "texstream.hpp"
+#include "my.hpp"
+
+namespace frontend {
+
+	TextureStream::TextureStream(Front & front): front(front) {
+		add_texture_user(this, [](void const* user, GLuint id) {
+			return ((TextureStream const*)user)->uses_texture(id);
+		});
+
+		#ifdef __EMSCRIPTEN__
+		for (auto & x: slots) {
+			x.mem.resize(slot_bytes);
+			x.ptr = x.mem.data();
+		}
+		#else
+		for (auto & x: slots) {
+			glGenBuffers(1, &x.pbo);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, x.pbo);
+			if (front.has_buffer_storage) {
+				// mapped for the buffer lifetime; coherent, no flushes
+				GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slot_bytes, nullptr, flags);
+				x.ptr = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot_bytes, flags);
+				if (not x.ptr) {
+					ext::fail("ERROR: TextureStream: cannot map pixel buffer\n");
+				}
+			}
+			else {
+				glBufferData(GL_PIXEL_UNPACK_BUFFER, slot_bytes, nullptr, GL_STREAM_DRAW);
+			}
+			CHECK_GL();
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		CHECK_GL();
+		#endif
+	}
+
+	TextureStream::~TextureStream() {
+		remove_texture_user(this);
+
+		#ifndef __EMSCRIPTEN__
+		for (auto & x: slots) {
+			if (x.fence) {
+				glDeleteSync(x.fence);
+			}
+			// deleting a buffer unmaps it
+			glDeleteBuffers(1, &x.pbo);
+		}
+		#endif
+	}
+
+	void TextureStream::retire() {
+		#ifndef __EMSCRIPTEN__
+		for (auto & x: slots) {
+			if (not x.fence) {
+				continue;
+			}
+			auto r = glClientWaitSync(x.fence, 0, 0);
+			if (r == GL_ALREADY_SIGNALED or r == GL_CONDITION_SATISFIED) {
+				glDeleteSync(x.fence);
+				x.fence = 0;
+				x.used = false;
+			}
+		}
+		CHECK_GL();
+		#endif
+	}
+
+	bool TextureStream::uses_texture(GLuint id) const {
+		for (auto & p: queue) {
+			if (p.tex == id) {
+				return true;
+			}
+		}
+		for (auto & x: slots) {
+			if (x.used and x.tex == id) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	int TextureStream::find_slot() {
+		for (int i = 0; i < slot_count; ++i) {
+			if (not slots[i].used) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	TextureStream::Staging TextureStream::reserve(Texture const& t, b2s region) {
+		assert(t.target == GL_TEXTURE_2D and t.format == GL_RGBA);
+		return reserve(t.id, region);
+	}
+
+	TextureStream::Staging TextureStream::reserve(GLuint tex, b2s region) {
+		size_t bytes = size_t(region.dim[0]) * size_t(region.dim[1]) * 4;
+		assert(bytes <= slot_bytes);
+
+		Staging s;
+
+		int i = find_slot();
+		if (i < 0) {
+			retire();
+			i = find_slot();
+		}
+		if (i < 0) {
+			stats.stalls += 1;
+			return s;
+		}
+
+		auto & x = slots[i];
+
+		#ifndef __EMSCRIPTEN__
+		if (not front.has_buffer_storage) {
+			// fence passed, gpu is done with the old contents
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, x.pbo);
+			x.ptr = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(bytes),
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+			);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			CHECK_GL();
+			if (not x.ptr) {
+				ext::fail("ERROR: TextureStream: cannot map pixel buffer\n");
+			}
+		}
+		#endif
+
+		x.used = true;
+		x.tex = tex;
+
+		s.data = x.ptr;
+		s.slot = i;
+		s.tex = tex;
+		s.region = region;
+		return s;
+	}
+
+	void TextureStream::commit(Staging & s) {
+		assert(s.slot >= 0);
+		auto & x = slots[s.slot];
+		auto & r = s.region;
+
+		front.flush_if_sampled(s.tex);
+		x.tex = 0;
+
+		glBindTexture(GL_TEXTURE_2D, s.tex);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		CHECK_GL();
+
+		#ifdef __EMSCRIPTEN__
+		glTexSubImage2D(GL_TEXTURE_2D, 0, r.pos[0], r.pos[1], r.dim[0], r.dim[1],
+			GL_RGBA, GL_UNSIGNED_BYTE, x.mem.data()
+		);
+		CHECK_GL();
+		x.used = false;
+		#else
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, x.pbo);
+		if (not front.has_buffer_storage) {
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			x.ptr = nullptr;
+		}
+
+		// pixels from start of bound buffer
+		glTexSubImage2D(GL_TEXTURE_2D, 0, r.pos[0], r.pos[1], r.dim[0], r.dim[1],
+			GL_RGBA, GL_UNSIGNED_BYTE, nullptr
+		);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		CHECK_GL();
+
+		x.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		CHECK_GL();
+		#endif
+
+		stats.uploads += 1;
+		stats.bytes += size_t(r.dim[0]) * size_t(r.dim[1]) * 4;
+
+		s = Staging();
+	}
+
+	void TextureStream::upload(Texture const& t, Image && img) {
+		assert(t.target == GL_TEXTURE_2D and t.format == GL_RGBA);
+		assert(img.get_dim() == t.dim);
+
+		queue.emplace_back();
+		auto & p = queue.back();
+		p.tex = t.id;
+		p.levels = t.levels;
+		p.img = std::move(img);
+	}
+
+	void TextureStream::update() {
+		retire();
+
+		// at least one band per frame
+		size_t sent = 0;
+		while (not queue.empty()) {
+			auto & p = queue.front();
+			auto d = p.img.get_dim();
+
+			size_t row_bytes = size_t(d[0]) * 4;
+			auto rows = int16_t(std::min<size_t>(slot_bytes / row_bytes, size_t(d[1] - p.row)));
+			size_t band = row_bytes * size_t(rows);
+			if (sent > 0 and sent + band > frame_budget) {
+				break;
+			}
+
+			auto s = reserve(p.tex, b2s(v2s(0, p.row), v2s(d[0], rows)));
+			if (not s.data) {
+				break;
+			}
+			memcpy(s.data, &p.img({0, p.row}), band);
+			commit(s);
+
+			sent += band;
+			p.row = int16_t(p.row + rows);
+
+			if (p.row == d[1]) {
+				if (p.levels > 1) {
+					glBindTexture(GL_TEXTURE_2D, p.tex);
+					glGenerateMipmap(GL_TEXTURE_2D);
+					CHECK_GL();
+				}
+				queue.pop_front();
+			}
+		}
+	}
+
+}
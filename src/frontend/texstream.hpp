@@ -0,0 +1,94 @@
+#pragma once
+#include <deque>
+#include "front.hpp"
+
+namespace frontend {
+
+	struct TextureStream {
+		/*
+			Asynchronous texture uploads through a ring of pixel unpack
+			buffers (PBO). Pixels go into a staging slot, glTexSubImage2D
+			sources the buffer and returns without waiting for the copy;
+			a fence tells when the slot may be written again.
+
+			Queued images are sent in row bands, about frame_budget bytes
+			per update, so a large upload spreads over frames.
+
+			With Front::has_buffer_storage slots stay persistently mapped
+			and staging data may be written on a worker thread between
+			reserve and commit (both on the GL thread). Otherwise slots are
+			mapped by reserve and unmapped by commit. WebGL has no buffer
+			mapping; slots are client memory uploaded directly.
+		*/
+
+		static size_t const slot_bytes = 4 << 20;  // 1024x1024 rgba
+		static int const slot_count = 8;
+
+		struct Staging {
+			uint8_t * data{nullptr};  // region.dim[1] rows of region.dim[0] rgba pixels
+			int slot{-1};
+			GLuint tex{0};
+			b2s region;
+		};
+
+		struct Stats {
+			size_t uploads{0};  // glTexSubImage2D calls
+			size_t bytes{0};    // uploaded bytes
+			size_t stalls{0};   // reserve found all slots in flight
+		};
+
+		size_t frame_budget{16 << 20};
+
+		TextureStream(Front & front);
+		TextureStream(TextureStream const&) = delete;
+		~TextureStream();
+
+		// staging memory for region of rgba texture t (at most slot_bytes);
+		// data is null when all slots are in flight, retry after update
+		Staging reserve(Texture const& t, b2s region);
+
+		// upload filled staging; mips are not regenerated
+		void commit(Staging & s);
+
+		// send img to t (equal dims) over the following updates; mips are
+		// regenerated after the last band; t must live until not busy
+		// (asserted by Texture::destroy)
+		void upload(Texture const& t, Image && img);
+
+		// once per frame: reuse finished slots, send queued bands; flushes
+		// the frame's quads only if they sample an updated texture
+		void update();
+
+		bool busy() const { return not queue.empty(); }
+
+		Stats const& get_stats() const { return stats; }
+
+	private:
+		struct Slot {
+			GLuint pbo{0};
+			GLsync fence{0};
+			uint8_t * ptr{nullptr};
+			bool used{false};
+			GLuint tex{0};  // reserved, not committed yet
+			std::vector<uint8_t> mem;  // webgl
+		};
+
+		struct Pending {
+			GLuint tex{0};
+			uint8_t levels{1};
+			Image img;
+			int16_t row{0};  // first row not sent
+		};
+
+		Front & front;
+		Slot slots[slot_count];
+		std::deque<Pending> queue;
+		Stats stats;
+
+		Staging reserve(GLuint tex, b2s region);
+		bool uses_texture(GLuint id) const;
+		int find_slot();
+		void retire();
+	};
+
+}
@@ -0,0 +1,262 @@
+#include "tilemap.hpp"
+#include "my.hpp"
+
+namespace frontend {
+
+	TileMap::TileMap(Front & front, Texture const& tileset, v2s tile_dim, v2s dim):
+		front(front), tileset(tileset), tile_dim(tile_dim), tiles(dim)
+	{
+		for (int16_t j = 0; j < dim[1]; ++j) {
+			for (int16_t i = 0; i < dim[0]; ++i) {
+				tiles(v2s(i,j)) = Empty;
+			}
+		}
+
+		nchunks = v2s(
+			int16_t((dim[0] + chunk_size - 1) / chunk_size),
+			int16_t((dim[1] + chunk_size - 1) / chunk_size)
+		);
+		chunks.resize(size_t(nchunks[0]) * size_t(nchunks[1]));
+		dirty.assign(chunks.size(), true);
+
+		#ifndef __EMSCRIPTEN__
+		// frag2 samples a sampler2D; array page views go through Front
+		use_mdi = front.has_draw_params and tileset.target == GL_TEXTURE_2D;
+		if (use_mdi) {
+			slot.assign(chunks.size(), -1);
+			nquads.assign(chunks.size(), 0);
+			glGenVertexArrays(1, &vao);
+			glGenBuffers(3, buf);
+			u_tex_dim = myGetUniformLocation(front.prog[3], "u_tex_dim");
+			CHECK_GL();
+		}
+		#endif
+	}
+
+	TileMap::~TileMap() {
+		if (vao != 0) {
+			glDeleteBuffers(3, buf);
+			glDeleteVertexArrays(1, &vao);
+		}
+	}
+
+	void TileMap::set(v2s pos, uint16_t tile) {
+		auto & t = tiles(pos);
+		if (t != tile) {
+			t = tile;
+			dirty[size_t(pos[1] / chunk_size) * nchunks[0] + pos[0] / chunk_size] = true;
+		}
+	}
+
+	template <class F>
+	void TileMap::for_tiles(v2s c, F f) const {
+		// f(trg, src); trg relative to chunk origin, fits int16 for any map size
+		auto cols = int16_t(tileset.dim[0] / tile_dim[0]);
+		auto dim = tiles.get_dim();
+		for (int16_t j = 0; j < chunk_size; ++j) {
+			for (int16_t i = 0; i < chunk_size; ++i) {
+				auto p = v2s(int16_t(c[0] * chunk_size + i), int16_t(c[1] * chunk_size + j));
+				if (p[0] >= dim[0] or p[1] >= dim[1]) {
+					continue;
+				}
+				auto t = tiles(p);
+				if (t == Empty) {
+					continue;
+				}
+				auto src = v2s(int16_t(t % cols * tile_dim[0]), int16_t(t / cols * tile_dim[1]));
+				auto trg = v2s(int16_t(i * tile_dim[0]), int16_t(j * tile_dim[1]));
+				f(trg, src);
+			}
+		}
+	}
+
+	void TileMap::build_chunk(v2s c) {
+		auto k = size_t(c[1]) * nchunks[0] + c[0];
+		auto & layer = chunks[k];
+		if (not layer) {
+			layer.reset(new StaticLayer(front));
+		}
+		layer->clear();
+
+		for_tiles(c, [&](v2s trg, v2s src) {
+			layer->add(tileset, trg, b2s(src, tile_dim));
+		});
+
+		dirty[k] = false;
+		stats.rebuilt += 1;
+	}
+
+	// vertices per slot, chunk_size^2 quads fit the static index buffer
+	size_t const SlotVerts = 4 * size_t(TileMap::chunk_size) * size_t(TileMap::chunk_size);
+
+	void TileMap::grow_slots() {
+		int32_t cap = slot_cap ? 2 * slot_cap : 16;
+		auto bytes = [](int32_t n) { return GLsizeiptr(n) * GLsizeiptr(SlotVerts * sizeof(Vertex)); };
+
+		// copy built slots into a larger buffer
+		GLuint nb;
+		glGenBuffers(1, &nb);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, nb);
+		glBufferData(GL_COPY_WRITE_BUFFER, bytes(cap), nullptr, GL_STATIC_DRAW);
+		if (slot_cap) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buf[0]);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes(nslots));
+		}
+		glDeleteBuffers(1, &buf[0]);
+		buf[0] = nb;
+
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, buf[0]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, front.ebo[0]);
+		front.set_vertex_format(0);
+		CHECK_GL();
+
+		slot_cap = cap;
+	}
+
+	void TileMap::build_chunk_mdi(v2s c) {
+		auto k = size_t(c[1]) * nchunks[0] + c[0];
+
+		verts.clear();
+		auto w = Color(255,255,255,255);
+		for_tiles(c, [&](v2s trg, v2s src) {
+			auto e = v2s(trg + tile_dim);
+			auto s = v2s(src + tile_dim);
+			Vertex vs[] = {
+				{trg[0], trg[1],  GLushort(src[0]), GLushort(src[1]),  w, 0, 0, 0},
+				{trg[0], e[1],    GLushort(src[0]), GLushort(s[1]),    w, 0, 0, 0},
+				{e[0], e[1],      GLushort(s[0]), GLushort(s[1]),      w, 0, 0, 0},
+				{e[0], trg[1],    GLushort(s[0]), GLushort(src[1]),    w, 0, 0, 0},
+			};
+			verts.insert(verts.end(), std::begin(vs), std::end(vs));
+		});
+
+		if (slot[k] < 0 and not verts.empty()) {
+			if (nslots == slot_cap) {
+				grow_slots();
+			}
+			slot[k] = nslots++;
+		}
+		if (not verts.empty()) {
+			glBindBuffer(GL_ARRAY_BUFFER, buf[0]);
+			glBufferSubData(GL_ARRAY_BUFFER, GLintptr(slot[k]) * GLintptr(SlotVerts * sizeof(Vertex)), verts.size() * sizeof(Vertex), verts.data());
+			CHECK_GL();
+		}
+		nquads[k] = uint16_t(verts.size() / 4);
+
+		dirty[k] = false;
+		stats.rebuilt += 1;
+	}
+
+	void TileMap::draw_mdi(int32_t const* r, v2s offset) {
+		int32_t cw = int32_t(chunk_size) * tile_dim[0];
+		int32_t ch = int32_t(chunk_size) * tile_dim[1];
+
+		cmds.clear();
+		offsets.clear();
+		for (int32_t y = r[1]; y < r[3]; ++y) {
+			for (int32_t x = r[0]; x < r[2]; ++x) {
+				auto k = size_t(y) * nchunks[0] + x;
+				if (dirty[k]) {
+					build_chunk_mdi(v2s(int16_t(x), int16_t(y)));
+				}
+				if (nquads[k] == 0) {
+					continue;
+				}
+				DrawCmd d;
+				d.count = GLuint(6 * nquads[k]);
+				d.instance_count = 1;
+				d.first_index = 0;
+				d.base_vertex = GLint(slot[k] * SlotVerts);
+				d.base_instance = 0;
+				cmds.push_back(d);
+				offsets.push_back(GLfloat(offset[0] + x * cw));
+				offsets.push_back(GLfloat(offset[1] + y * ch));
+			}
+		}
+
+		stats.drawn = cmds.size();
+		if (cmds.empty()) {
+			return;
+		}
+
+		#ifndef __EMSCRIPTEN__
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buf[1]);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, cmds.size() * sizeof(DrawCmd), cmds.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buf[2]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, offsets.size() * sizeof(GLfloat), offsets.data(), GL_STREAM_DRAW);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, buf[2]);
+
+		glUseProgram(front.prog[3]);
+		auto d = tileset.get_store_dim();
+		glUniform2f(u_tex_dim, d[0], d[1]);
+		assert(tileset.target == GL_TEXTURE_2D);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, tileset.id);
+		glBindSampler(0, front.samplers[sampler]);
+		glBindVertexArray(vao);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, GLsizei(cmds.size()), 0);
+		CHECK_GL();
+
+		glBindSampler(0, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glUseProgram(front.prog[0]);
+		CHECK_GL();
+
+		front.stats.draws += 1;
+		#endif
+	}
+
+	void TileMap::draw(v2s offset, b2s view) {
+		// chunk extent in pixels
+		int32_t cw = int32_t(chunk_size) * tile_dim[0];
+		int32_t ch = int32_t(chunk_size) * tile_dim[1];
+
+		// visible chunk range x0 y0 x1 y1, floor division for negative offsets
+		auto first = [](int32_t a, int32_t d) { return a >= 0 ? a / d : -((-a + d - 1) / d); };
+		int32_t r[4] = {
+			std::max<int32_t>(0, first(int32_t(view.pos[0]) - offset[0], cw)),
+			std::max<int32_t>(0, first(int32_t(view.pos[1]) - offset[1], ch)),
+			std::min<int32_t>(nchunks[0], first(int32_t(view.pos[0]) + view.dim[0] - offset[0] - 1, cw) + 1),
+			std::min<int32_t>(nchunks[1], first(int32_t(view.pos[1]) + view.dim[1] - offset[1] - 1, ch) + 1),
+		};
+
+		// filtering as set on front now, on both paths
+		auto q = make_quad(tileset, 0, v2s(0,0), tile_dim, v2s(0,0), tile_dim, Color(255,255,255,255));
+		auto samp = fit_sampler(front.cur_sampler, q);
+		if (samp != sampler) {
+			sampler = samp;
+			if (not use_mdi) {
+				// chunk layers keep the sampler they were recorded with
+				std::fill(dirty.begin(), dirty.end(), true);
+			}
+		}
+
+		if (use_mdi) {
+			front.flush();
+			draw_mdi(r, offset);
+			stats.culled = chunks.size() - stats.drawn;
+			return;
+		}
+
+		stats.drawn = 0;
+		for (int32_t y = r[1]; y < r[3]; ++y) {
+			for (int32_t x = r[0]; x < r[2]; ++x) {
+				auto c = v2s(int16_t(x), int16_t(y));
+				auto k = size_t(y) * nchunks[0] + x;
+				if (dirty[k]) {
+					build_chunk(c);
+				}
+				if (chunks[k]->size() == 0) {
+					continue;
+				}
+				// visible chunk origin is near the view, fits int16
+				auto pos = v2s(int16_t(offset[0] + x * cw), int16_t(offset[1] + y * ch));
+				front.draw_layer(*chunks[k], pos);
+				stats.drawn += 1;
+			}
+		}
+		stats.culled = chunks.size() - stats.drawn;
+	}
+
+}
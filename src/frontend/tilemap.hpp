@@ -0,0 +1,96 @@
+#pragma once
+#include <memory>
+#include "front.hpp"
+#include "staticlayer.hpp"
+
+namespace frontend {
+
+	struct TileMap {
+		/*
+			Grid of tile indices into a tileset texture; tiles of the
+			tileset are numbered row by row.
+			The grid is split into chunk_size^2 chunks, each a StaticLayer
+			built when first visible and rebuilt only after its tiles change.
+			Chunks outside the view are not touched at all.
+
+			With Front::has_draw_params all chunks live in slots of one
+			vertex buffer and the visible ones go out in a single
+			glMultiDrawElementsIndirect, each draw fetching its translation
+			by gl_DrawID; otherwise chunks are drawn one by one.
+			The multi-draw samples a plain GL_TEXTURE_2D; array page
+			tilesets take the chunk by chunk path. Tilesets are rgba or
+			mask textures (no palette lookup). Both paths filter with the
+			Front sampler at draw time; chunk by chunk, changing it
+			rebuilds the chunks.
+		*/
+
+		static int16_t const chunk_size = 32;
+		static uint16_t const Empty = 0xffff;
+
+		using Grid = darray2::darray2<uint16_t, int16_t>;
+
+		struct Stats {
+			size_t drawn{0};    // chunks drawn by last draw
+			size_t culled{0};   // chunks skipped by last draw
+			size_t rebuilt{0};  // chunks rebuilt, total
+		};
+
+		TileMap(Front & front, Texture const& tileset, v2s tile_dim, v2s dim);
+		TileMap(TileMap const&) = delete;
+		~TileMap();
+
+		void set(v2s pos, uint16_t tile);
+		uint16_t get(v2s pos) const { return tiles(pos); }
+
+		v2s get_dim() const { return tiles.get_dim(); }
+		v2s get_tile_dim() const { return tile_dim; }
+
+		// draw map with its origin at offset; view is the visible screen box
+		void draw(v2s offset, b2s view);
+
+		Stats const& get_stats() const { return stats; }
+
+	private:
+		Front & front;
+		Texture const& tileset;
+		v2s tile_dim;
+		Grid tiles;
+
+		v2s nchunks;
+		std::vector<std::unique_ptr<StaticLayer>> chunks;  // null until visible
+		std::vector<bool> dirty;
+		SamplerOpts sampler{SampNearest};  // of last draw
+
+		// multi-draw: chunk k in slot[k] of vbo
+		struct DrawCmd {
+			GLuint count;
+			GLuint instance_count;
+			GLuint first_index;
+			GLint base_vertex;
+			GLuint base_instance;
+		};
+
+		bool use_mdi{false};
+		GLuint vao{0};
+		GLuint buf[3]{};  // vertices, commands, offsets
+		std::vector<int32_t> slot;
+		std::vector<uint16_t> nquads;
+		int32_t nslots{0};
+		int32_t slot_cap{0};
+		std::vector<Vertex> verts;
+		std::vector<DrawCmd> cmds;
+		std::vector<GLfloat> offsets;
+		GLint u_tex_dim{-1};
+
+		Stats stats;
+
+		template <class F>
+		void for_tiles(v2s c, F f) const;
+
+		void build_chunk(v2s c);
+		void build_chunk_mdi(v2s c);
+		void grow_slots();
+		void draw_mdi(int32_t const* r, v2s offset);
+	};
+
+}
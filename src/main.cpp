@@ -1,4 +1,5 @@
 #include "frontend/front.hpp"
+#include "frontend/pack.hpp"
 
 
 
@@ -39,11 +40,18 @@ using frontend::Front;
 using frontend::Texture;
 using frontend::Color;
 using frontend::Image;
+using frontend::AssetPack;
 
 int main() {
 
 	Front front;
 	front.init("Ala ma Kota", {800,600});
+
+	// optional, see: make pack
+	AssetPack pack;
+	if (pack.open("res/assets.pack")) {
+		front.pack = &pack;
+	}
 	
 			
 
@@ -1,9 +1,524 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <random>
+
+#include "frontend/front.hpp"
+#include "frontend/dirtyrect.hpp"
+#include "frontend/pack.hpp"
+#include "frontend/bcn.hpp"
+#include "frontend/radix.hpp"
+#include "frontend/spatialgrid.hpp"
+#include "frontend/texcache.hpp"
+#include "lodepng/lodepng.h"
+
+using frontend::DirtyRect;
+using frontend::b2s;
+using frontend::v2s;
+using frontend::Image;
+using frontend::Color;
+
 
 TEST_CASE( "AAA", "" ) {
 	
 }
 
+TEST_CASE( "dirty rect merges touching boxes", "[dirtyrect]" ) {
+	DirtyRect d;
+	REQUIRE(d.empty());
+
+	d.add(b2s(v2s(0,0), v2s(4,4)));
+	d.add(b2s(v2s(4,0), v2s(4,4)));
+	REQUIRE(d.count == 1);
+	REQUIRE(d.rects[0].dim == v2s(8,4));
+
+	d.add(b2s(v2s(100,100), v2s(2,2)));
+	REQUIRE(d.count == 2);
+
+	// zero size ignored
+	d.add(b2s(v2s(50,50), v2s(0,3)));
+	REQUIRE(d.count == 2);
+
+	auto b = d.get_bounds();
+	REQUIRE(b.pos == v2s(0,0));
+	REQUIRE(b.dim == v2s(102,102));
+}
+
+TEST_CASE( "dirty rect stays bounded", "[dirtyrect]" ) {
+	DirtyRect d;
+	for (int i = 0; i < 20; ++i) {
+		d.add(b2s(v2s(int16_t(i*10), int16_t(i*10)), v2s(2,2)));
+	}
+	int max_rects = DirtyRect::max_rects;
+	REQUIRE(d.count <= max_rects);
+	REQUIRE(d.get_bounds().dim == v2s(192,192));
+}
+
+TEST_CASE( "asset pack roundtrip", "[pack]" ) {
+	Image img(v2s(3,2));
+	for (int16_t j = 0; j < 2; ++j) {
+		for (int16_t i = 0; i < 3; ++i) {
+			img(v2s(i,j)) = Color(uint8_t(i), uint8_t(j), 7, 255);
+		}
+	}
+
+	for (bool z: {false, true}) {
+		frontend::PackWriter w;
+		w.compress = z;
+		w.add_image("a.png", img);
+		w.write("build/test.pack");
+
+		frontend::AssetPack pack;
+		REQUIRE(pack.open("build/test.pack"));
+		REQUIRE(pack.find("b.png") == nullptr);
+
+		auto e = pack.find("a.png");
+		REQUIRE(e != nullptr);
+		REQUIRE(e->dim[0] == 3);
+		REQUIRE(e->dim[1] == 2);
+
+		std::vector<uint8_t> buf;
+		auto p = pack.get_pixels(*e, buf);
+		REQUIRE(memcmp(p, &img(v2s(0,0)), 3*2*4) == 0);
+	}
+}
+
+TEST_CASE( "asset pack stores bgra swizzled", "[pack]" ) {
+	Image img(v2s(2,1));
+	img(v2s(0,0)) = Color(1, 2, 3, 4);
+	img(v2s(1,0)) = Color(5, 6, 7, 8);
+
+	frontend::PackWriter w;
+	w.add_image("a.png", img, frontend::FormatBGRA);
+	w.write("build/test.pack");
+
+	frontend::AssetPack pack;
+	REQUIRE(pack.open("build/test.pack"));
+	auto e = pack.find("a.png");
+	REQUIRE(e != nullptr);
+	REQUIRE(e->format == frontend::FormatBGRA);
+
+	std::vector<uint8_t> buf;
+	auto p = pack.get_pixels(*e, buf);
+	uint8_t expect[] = {3, 2, 1, 4, 7, 6, 5, 8};
+	REQUIRE(memcmp(p, expect, 8) == 0);
+}
+
+TEST_CASE( "asset pack rejects entries out of bounds", "[pack]" ) {
+	frontend::PackEntry e;
+	memset(&e, 0, sizeof(e));
+	e.codec = frontend::PackRaw;
+	e.format = GL_RGBA;
+	e.dim[0] = 2;
+	e.dim[1] = 2;
+	e.offset = 32;
+	e.size = 16;
+	REQUIRE(frontend::check_pack_entry(e, 48, 0));
+
+	// data past the mapping
+	REQUIRE_FALSE(frontend::check_pack_entry(e, 47, 0));
+
+	// too few pixels for dim
+	e.dim[1] = 3;
+	REQUIRE_FALSE(frontend::check_pack_entry(e, 48, 0));
+	e.dim[1] = 2;
+
+	// glyphs past the table, also when the sum wraps
+	e.glyph_first = 3;
+	e.glyph_count = 2;
+	REQUIRE(frontend::check_pack_entry(e, 48, 5));
+	REQUIRE_FALSE(frontend::check_pack_entry(e, 48, 4));
+	e.glyph_first = 0xffffffffu;
+	REQUIRE_FALSE(frontend::check_pack_entry(e, 48, 4));
+}
+
+TEST_CASE( "cached load finds packed entry", "[pack]" ) {
+	Image img(v2s(2,2));
+	frontend::PackWriter w;
+	w.add_image("build/cached.png", img);
+	w.write("build/test.pack");
+
+	// existing file, so the cache key is an absolute path
+	std::ofstream("build/cached.png") << "png";
+
+	frontend::AssetPack pack;
+	REQUIRE(pack.open("build/test.pack"));
+
+	bool found = false;
+	frontend::TextureCache cache;
+	cache.get("build/cached.png", frontend::TexNone, [&](filesys::Path const& path, frontend::TexOpts) {
+		found = pack.find(path) != nullptr;
+		frontend::Texture t;
+		t.dim = v2s(2,2);
+		return t;
+	});
+	REQUIRE(found);
+}
+
+TEST_CASE( "texture cache evicts unused entries in lru order", "[texcache]" ) {
+	frontend::TextureCache cache;
+	cache.max_unused = 2;
+
+	// no GL: textures of id 0 only carry their size
+	int loads = 0;
+	auto load = [&](filesys::Path const&, frontend::TexOpts) {
+		loads += 1;
+		frontend::Texture t;
+		t.dim = v2s(4,4);
+		return t;
+	};
+	auto get = [&](char const* path) {
+		return cache.get(path, frontend::TexNone, load);
+	};
+
+	// hit shares the texture
+	auto a = get("cache/a.png");
+	REQUIRE(get("cache/a.png") == a);
+	REQUIRE(loads == 1);
+	REQUIRE(cache.get_stats().hits == 1);
+	REQUIRE(cache.get_stats().misses == 1);
+
+	// other opts are another entry
+	cache.get("cache/a.png", frontend::TexMipmap, load);
+	REQUIRE(loads == 2);
+
+	// beyond 2 unused the oldest (a with mips) goes; a is older but
+	// referenced and stays
+	get("cache/b.png");
+	get("cache/c.png");
+	REQUIRE(cache.size() == 4);
+	get("cache/d.png");
+	REQUIRE(cache.size() == 4);
+	REQUIRE(cache.get_stats().evictions == 1);
+	REQUIRE(get("cache/a.png") == a);
+	REQUIRE(loads == 5);
+
+	// a hit refreshes the entry
+	get("cache/c.png");
+	cache.max_unused = 1;
+	cache.trim();
+	REQUIRE(cache.size() == 2);
+	get("cache/c.png");
+	REQUIRE(loads == 5);
+	get("cache/d.png");
+	REQUIRE(loads == 6);
+
+	a.reset();
+	cache.purge();
+	REQUIRE(cache.size() == 0);
+	REQUIRE(cache.get_stats().bytes == 0);
+}
+
+TEST_CASE( "bc1 block roundtrip", "[bcn]" ) {
+	Color px[16], out[16];
+	uint8_t block[8];
+
+	// solid colour survives 565 quantization exactly for these values
+	for (auto & c: px) c = Color(255, 0, 255, 255);
+	frontend::encode_bc1_block(block, px, false);
+	frontend::decode_bc1_block(out, block);
+	for (auto & c: out) REQUIRE(c == Color(255, 0, 255, 255));
+
+	// gradient of 16 levels -> 4 palette entries 80 apart
+	for (int i = 0; i < 16; ++i) {
+		px[i] = Color(uint8_t(i*16), uint8_t(i*16), uint8_t(i*16), 255);
+	}
+	frontend::encode_bc1_block(block, px, false);
+	frontend::decode_bc1_block(out, block);
+	for (int i = 0; i < 16; ++i) {
+		REQUIRE(std::abs(int(out[i].r) - int(px[i].r)) <= 40 + 4);
+	}
+}
+
+TEST_CASE( "bc1 keeps contrast off the grey axis", "[bcn]" ) {
+	Color px[16], out[16];
+	uint8_t block[8];
+
+	// red and green: colour axis orthogonal to (1,1,1)
+	for (int i = 0; i < 16; ++i) {
+		px[i] = (i % 2) ? Color(255, 0, 0, 255) : Color(0, 255, 0, 255);
+	}
+	frontend::encode_bc1_block(block, px, false);
+	frontend::decode_bc1_block(out, block);
+	for (int i = 0; i < 16; ++i) {
+		REQUIRE(out[i] == px[i]);
+	}
+}
+
+TEST_CASE( "bc3 keeps alpha", "[bcn]" ) {
+	Image img(v2s(5,3));
+	for (int16_t j = 0; j < 3; ++j) {
+		for (int16_t i = 0; i < 5; ++i) {
+			img(v2s(i,j)) = Color(10, 20, 30, (i+j) % 2 ? 255 : 0);
+		}
+	}
+	REQUIRE(frontend::has_alpha(img));
+
+	std::vector<uint8_t> blocks;
+	frontend::encode_bc(blocks, frontend::FormatBC3, img);
+	REQUIRE(blocks.size() == 2*1*16);
+
+	std::vector<uint8_t> rgba(5*3*4);
+	frontend::decode_bc(rgba.data(), frontend::FormatBC3, blocks.data(), v2s(5,3));
+	for (int k = 0; k < 5*3; ++k) {
+		REQUIRE(rgba[k*4+3] == (&img(v2s(0,0)))[k].a);
+	}
+}
+
+TEST_CASE( "mask detection", "[mask]" ) {
+	Color frame(178, 178, 178, 255);
+	Image img(v2s(3,1));
+	img(v2s(0,0)) = frame;
+	img(v2s(1,0)) = Color(0,0,0,0);
+	img(v2s(2,0)) = Color(255,255,255,255);
 
+	REQUIRE(frontend::is_mask(img, frame));
+	REQUIRE(not frontend::is_mask(img, Color(0,0,0,0)));
+
+	auto m = frontend::to_mask(img, frame);
+	REQUIRE(m.size() == 3);
+	REQUIRE(m[0] == 0);
+	REQUIRE(m[1] == 0);
+	REQUIRE(m[2] == 255);
+}
+
+TEST_CASE( "palette png decodes to indices", "[palette]" ) {
+	// 3x2, 2 bits per pixel
+	std::vector<uint8_t> idx = {0,1,2, 3,2,1};
+
+	lodepng::State state;
+	state.encoder.auto_convert = 0;
+	for (auto * m: {&state.info_raw, &state.info_png.color}) {
+		m->colortype = LCT_PALETTE;
+		lodepng_palette_add(m, 255, 0, 0, 255);
+		lodepng_palette_add(m, 0, 255, 0, 255);
+		lodepng_palette_add(m, 0, 0, 255, 255);
+		lodepng_palette_add(m, 0, 0, 0, 0);
+	}
+	state.info_raw.bitdepth = 8;
+	state.info_png.color.bitdepth = 2;
+
+	std::vector<uint8_t> png;
+	REQUIRE(lodepng::encode(png, idx, 3, 2, state) == 0);
+	lodepng::save_file(png, "build/test_palette.png");
+
+	frontend::IndexedImage img;
+	REQUIRE(frontend::load_png_indexed(img, "build/test_palette.png"));
+	REQUIRE(img.dim == v2s(3,2));
+	REQUIRE(img.index == idx);
+	REQUIRE(img.palette.size() == 4);
+	REQUIRE(img.palette[2] == Color(0,0,255,255));
+}
+
+TEST_CASE( "radix sort matches std::sort", "[radix]" ) {
+	std::mt19937_64 rng(7);
+	std::vector<uint64_t> keys, tmp;
+	for (int i = 0; i < 1000; ++i) {
+		// few distinct high bytes, like layer/texture keys
+		keys.push_back((uint64_t(rng() % 3) << 56) | (uint64_t(rng() % 5) << 32) | uint64_t(i));
+	}
+	auto ref = keys;
+	std::sort(ref.begin(), ref.end());
+
+	frontend::radix_sort(keys, tmp);
+	REQUIRE(keys == ref);
+
+	// already sorted input
+	frontend::radix_sort(keys, tmp);
+	REQUIRE(keys == ref);
+}
+
+TEST_CASE( "clip quad adjusts uv", "[clip]" ) {
+	auto clip = b2s(v2s(10,10), v2s(20,20));
+
+	// sprite 16x16 at 4,4 from texels 32,0
+	v2s pos(4,4), end(20,20), uv0(32,0), uv1(48,16);
+	REQUIRE(frontend::clip_quad(clip, pos, end, uv0, uv1));
+	REQUIRE(pos == v2s(10,10));
+	REQUIRE(end == v2s(20,20));
+	REQUIRE(uv0 == v2s(38,6));
+	REQUIRE(uv1 == v2s(48,16));
+
+	// outside
+	pos = v2s(40,0); end = v2s(50,10);
+	REQUIRE_FALSE(frontend::clip_quad(clip, pos, end, uv0, uv1));
+}
+
+TEST_CASE( "view culling does not wrap", "[clip]" ) {
+	auto dim = v2s(320,200);
+	auto view = v2s(30000,0);
+
+	// 60000 px left of the view; int16 subtraction would land inside
+	v2s pos(-30000,10), end(-29990,20), uv0(0,0), uv1(10,10);
+	REQUIRE_FALSE(frontend::view_quad(view, dim, false, pos, end, uv0, uv1));
+
+	pos = v2s(30010,10); end = v2s(30020,20);
+	REQUIRE(frontend::view_quad(view, dim, false, pos, end, uv0, uv1));
+	REQUIRE(pos == v2s(10,10));
+	REQUIRE(end == v2s(20,20));
+	REQUIRE(uv0 == v2s(0,0));
+	REQUIRE(uv1 == v2s(10,10));
+
+	// context coords beyond int16 are cut even without clip
+	view = v2s(20000,0);
+	pos = v2s(-20000,0); end = v2s(30000,10); uv0 = v2s(0,0); uv1 = v2s(5000,10);
+	REQUIRE(frontend::view_quad(view, dim, false, pos, end, uv0, uv1));
+	REQUIRE(pos == v2s(0,0));
+	REQUIRE(end == v2s(320,10));
+	REQUIRE(uv0 == v2s(4000,0));
+	REQUIRE(uv1 == v2s(4032,10));
+}
+
+TEST_CASE( "spatial grid query matches scan", "[spatialgrid]" ) {
+	using frontend::SpatialGrid;
+
+	std::mt19937 rng(3);
+	std::uniform_int_distribution<int> coord(-2000, 2000);
+	std::uniform_int_distribution<int> size(1, 600);
+
+	SpatialGrid grid(6);
+	std::vector<b2s> boxes;
+	std::vector<SpatialGrid::Handle> hs;
+	for (int i = 0; i < 500; ++i) {
+		auto b = b2s(v2s(int16_t(coord(rng)), int16_t(coord(rng))), v2s(int16_t(size(rng)), int16_t(size(rng))));
+		boxes.push_back(b);
+		hs.push_back(grid.insert(b, uint32_t(i)));
+	}
+
+	// move half, remove some
+	for (int i = 0; i < 500; i += 2) {
+		boxes[i].pos[0] = int16_t(boxes[i].pos[0] + 300);
+		grid.move(hs[i], boxes[i]);
+	}
+	for (int i = 1; i < 500; i += 7) {
+		grid.remove(hs[i]);
+		boxes[i].dim = v2s(0,0);
+	}
+
+	auto view = b2s(v2s(-300,-200), v2s(640,480));
+	std::vector<SpatialGrid::Handle> out;
+	grid.query(view, out);
+
+	std::vector<uint32_t> got, ref;
+	for (auto h: out) {
+		got.push_back(grid.get_data(h));
+	}
+	for (uint32_t i = 0; i < boxes.size(); ++i) {
+		auto & b = boxes[i];
+		if (b.dim[0] > 0 and
+			b.pos[0] < view.pos[0] + view.dim[0] and view.pos[0] < b.pos[0] + b.dim[0] and
+			b.pos[1] < view.pos[1] + view.dim[1] and view.pos[1] < b.pos[1] + b.dim[1])
+		{
+			ref.push_back(i);
+		}
+	}
+	std::sort(got.begin(), got.end());
+	REQUIRE(got == ref);
+}
+
+TEST_CASE( "spatial grid stores occupied cells only", "[spatialgrid]" ) {
+	using frontend::SpatialGrid;
+
+	// 1 pixel cells over the whole plane
+	SpatialGrid grid(0);
+	auto a = grid.insert(b2s(v2s(-30000,-30000), v2s(2,2)), 1);
+	auto b = grid.insert(b2s(v2s(30000,30000), v2s(1,1)), 2);
+
+	std::vector<SpatialGrid::Handle> out;
+	grid.query(b2s(v2s(-30001,-30001), v2s(4,4)), out);
+	REQUIRE(out == std::vector<SpatialGrid::Handle>{a});
+
+	// query over more cells than are occupied
+	out.clear();
+	grid.query(b2s(v2s(-32768,-32768), v2s(32767,32767)), out);
+	std::sort(out.begin(), out.end());
+	REQUIRE(out == std::vector<SpatialGrid::Handle>{a});
+	REQUIRE(grid.get_stats().cells == 4);
+
+	grid.remove(a);
+	out.clear();
+	grid.query(b2s(v2s(29999,29999), v2s(4,4)), out);
+	REQUIRE(out == std::vector<SpatialGrid::Handle>{b});
+}
+
+TEST_CASE( "nine slice covers target", "[nineslice]" ) {
+	using frontend::Slice;
+
+	auto trg = b2s(v2s(10,20), v2s(100,50));
+	auto src = b2s(v2s(0,0), v2s(24,24));
+	frontend::Borders b;
+	b.left = b.top = b.right = b.bottom = 8;
+
+	for (bool tile: {false, true}) {
+		std::vector<Slice> out;
+		frontend::nine_slice(out, trg, src, b, tile);
+
+		int32_t area = 0;
+		for (auto & p: out) {
+			area += int32_t(p.trg.dim[0]) * p.trg.dim[1];
+			// tiles and corners are never scaled
+			if (tile) {
+				REQUIRE(p.trg.dim == p.src.dim);
+			}
+		}
+		REQUIRE(area == 100 * 50);
+		REQUIRE(out.size() == (tile ? 4 + 2*11 + 2*5 + 11*5 : 9));
+	}
+}
+
+TEST_CASE( "nine slice squeezes small targets", "[nineslice]" ) {
+	using frontend::Slice;
+
+	// narrower than left + right: corners scale down, middle column drops
+	auto trg = b2s(v2s(0,0), v2s(10,40));
+	auto src = b2s(v2s(0,0), v2s(24,24));
+	frontend::Borders b;
+	b.left = b.top = b.right = b.bottom = 8;
+
+	std::vector<Slice> out;
+	frontend::nine_slice(out, trg, src, b, false);
+	REQUIRE(out.size() == 6);
+
+	auto & tl = out[0];
+	REQUIRE(tl.trg.pos == v2s(0,0));
+	REQUIRE(tl.trg.dim == v2s(5,8));
+	REQUIRE(tl.src.pos == v2s(0,0));
+	REQUIRE(tl.src.dim == v2s(8,8));
+
+	auto & tr = out[1];
+	REQUIRE(tr.trg.pos == v2s(5,0));
+	REQUIRE(tr.trg.dim == v2s(5,8));
+	REQUIRE(tr.src.pos == v2s(16,0));
+	REQUIRE(tr.src.dim == v2s(8,8));
+}
+
+TEST_CASE( "fit sampler keeps options the texture supports", "[sampler]" ) {
+	using namespace frontend;
+	auto all = SamplerOpts(SampLinear | SampRepeat | SampMipmap);
+
+	// no gl calls; texture ids only label quads
+	Texture t;
+	t.dim = v2s(16,16);
+	auto q = make_quad(t, 0, v2s(0,0), v2s(16,16), v2s(0,0), v2s(16,16), Color(255,255,255,255));
+	REQUIRE(fit_sampler(all, q) == SamplerOpts(SampLinear | SampRepeat));
+
+	t.levels = 5;
+	q = make_quad(t, 0, v2s(0,0), v2s(16,16), v2s(0,0), v2s(16,16), Color(255,255,255,255));
+	REQUIRE(fit_sampler(all, q) == all);
+
+	// palette lookups stay nearest
+	q.pal = 1;
+	REQUIRE(fit_sampler(all, q) == SampNearest);
+
+	// layer of a larger array page: no repeat
+	Texture a;
+	a.dim = v2s(10,16);
+	a.target = GL_TEXTURE_2D_ARRAY;
+	a.page = v2s(16,16);
+	a.owner = false;
+	q = make_quad(a, 0, v2s(0,0), v2s(10,16), v2s(0,0), v2s(10,16), Color(255,255,255,255));
+	REQUIRE(fit_sampler(all, q) == SampLinear);
+}